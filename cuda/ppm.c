@@ -121,9 +121,31 @@ void write_tensor_to_ppm(const char* filename, uint8_t*** tensor, int width, int
     fclose(file);
 }
 
+// Single-channel output: one luma byte per pixel instead of three copies
+void write_tensor_to_pgm(const char* filename, uint8_t*** tensor, int width, int height) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening file for writing\n");
+        return;
+    }
+
+    // Write PGM header
+    fprintf(file, "P5\n%d %d\n255\n", width, height);
+
+    // Write pixel data (greyscale tensors hold the same value in every channel)
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            fputc(tensor[i][j][0], file);
+        }
+    }
+
+    fclose(file);
+}
+
 void print_usage(const char* program_name) {
-    printf("Usage: %s <input_file.ppm> <output_file.ppm>\n", program_name);
+    printf("Usage: %s <input_file.ppm> <output_file.ppm|output_file.pgm>\n", program_name);
     printf("Converts a PPM image to greyscale.\n");
+    printf("A .pgm output is written as single-channel P5.\n");
 }
 
 int main(int argc, char* argv[]) {
@@ -142,12 +164,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Check if output file has .ppm extension
+    // Check if output file has .ppm or .pgm extension
     const char* output_ext = strrchr(output_filename, '.');
-    if (!output_ext || strcmp(output_ext, ".ppm") != 0) {
-        fprintf(stderr, "Error: Output file must have .ppm extension\n");
+    if (!output_ext || (strcmp(output_ext, ".ppm") != 0 && strcmp(output_ext, ".pgm") != 0)) {
+        fprintf(stderr, "Error: Output file must have .ppm or .pgm extension\n");
         return 1;
     }
+    int pgm = strcmp(output_ext, ".pgm") == 0;
 
     int width, height;
     uint8_t*** tensor = read_ppm_to_tensor(input_filename, &width, &height);
@@ -159,8 +182,12 @@ int main(int argc, char* argv[]) {
         // Convert the image to greyscale
         convert_to_greyscale(tensor, height, width);
 
-        // Write the modified tensor back to a new PPM file
-        write_tensor_to_ppm(output_filename, tensor, width, height);
+        // Write the modified tensor back to a new PPM (or PGM) file
+        if (pgm) {
+            write_tensor_to_pgm(output_filename, tensor, width, height);
+        } else {
+            write_tensor_to_ppm(output_filename, tensor, width, height);
+        }
         printf("Greyscale image saved as %s\n", output_filename);
 
         // Free the tensor
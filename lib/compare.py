@@ -0,0 +1,175 @@
+"""
+Golden-image and speed comparison between lib/shaders.py and the C filters in video/.
+
+Every effect is run through both implementations on a small deterministic corpus.
+Each output is checked against its own implementation's golden in lib/golden/
+(regenerated with --update-golden), and the Python and C outputs are checked against
+each other. The run fails if either output drifts from its golden or the two
+implementations disagree by more than the effect's tolerance. The speedup compares
+one in-process Python call against the C kernel time reported by --perf.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+from shaders import *
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+VIDEO_DIR = os.path.join(ROOT, "video")
+GOLDEN_DIR = os.path.join(ROOT, "lib", "golden")
+
+# (max, mean) difference allowed between an output and its own golden, enough
+# for rounding differences between compilers and OpenCV versions
+GOLDEN_TOLERANCE = (1, 0.01)
+
+# name -> (python implementation, C filter and arguments,
+#          (max, mean) python-to-C tolerance, border left out of that comparison)
+# shaders.kuwahara(ksize=3) samples the same 3x3 quadrants as ./kuwahara --ksize 5.
+# By default the shader picks the quadrant with the lowest mean standard deviation
+# while the C filter uses the lowest mean variance, which flips whole pixels, so it
+# is compared with by_variance=True. The C filters clip their kernels at the border
+# while the shaders reflect, so kuwahara is compared inside its 2-pixel halo and
+# box_blur gets a looser tolerance; what's left for kuwahara is rounding of the
+# quadrant mean and the odd tie.
+EFFECTS = {
+    "ordered_dither": (ordered_dither, ["dither2"], (0, 0.0), 0),
+    "ordered_dither_2": (ordered_dither_2, ["dither"], (0, 0.0), 0),
+    "kuwahara": (lambda img: kuwahara(img, 3, by_variance=True), ["kuwahara", "--ksize", "5"], (16, 1.0), 2),
+    "box_blur": (lambda img: box_blur(img, 5), ["blur"], (32, 1.0), 0),
+}
+
+# frames sent per C run; the filters drop the first, and the kernel time is the
+# mean over the rest as reported by --perf
+C_FRAMES = 11
+
+
+def corpus(width: int) -> dict:
+    birb = cv2.imread(os.path.join(ROOT, "birb.jpg"))
+    h, w = birb.shape[:2]
+    birb = cv2.resize(birb, (width, h * width // w), interpolation=cv2.INTER_AREA)
+
+    h = width * 3 // 4
+    x = np.tile(np.linspace(0, 255, width).astype(np.uint8), (h, 1))
+    y = np.tile(np.linspace(0, 255, h).astype(np.uint8)[:, None], (1, width))
+    gradient = np.dstack([x, y, 255 - x])
+    checker = (((np.indices((h, width)) // 8).sum(0) % 2) * 255).astype(np.uint8)
+    noise = np.random.default_rng(0).integers(0, 256, (h, width, 3), dtype=np.uint8)
+
+    return {
+        "birb": birb,
+        "gradient": gradient,
+        "checker": cv2.cvtColor(checker, cv2.COLOR_GRAY2BGR),
+        "noise": noise,
+    }
+
+
+def build(bin_dir: str) -> None:
+    for _, (c_filter, *_), *_ in EFFECTS.values():
+        src = os.path.join(VIDEO_DIR, c_filter + ".c")
+        subprocess.run(["cc", "-O2", src, "-o", os.path.join(bin_dir, c_filter)], check=True)
+
+
+def run_c(cmd: list, img: np.ndarray) -> tuple:
+    """Run a C filter on img; returns its output, seconds per kernel call and the --perf report."""
+    rgb = cv2.cvtColor(img, cv2.COLOR_BGR2RGB)
+    h, w = rgb.shape[:2]
+    frame = b"P6\n%d %d\n255\n" % (w, h) + rgb.tobytes()
+
+    # time the kernel itself, not process start-up and pipe I/O
+    result = subprocess.run([*cmd, "--perf"], input=frame * C_FRAMES, capture_output=True, check=True)
+    report = result.stderr.decode()
+    calls, seconds = re.search(r"(\d+) calls, \d+ pixels, ([\d.]+) s", report).groups()
+
+    out = result.stdout
+    pixels = np.frombuffer(out[len(out) - w * h * 3 :], np.uint8).reshape(h, w, 3)
+    return cv2.cvtColor(pixels, cv2.COLOR_RGB2BGR), float(seconds) / int(calls), report
+
+
+def diff(a: np.ndarray, b: np.ndarray, border: int = 0) -> tuple:
+    if border:
+        a = a[border:-border, border:-border]
+        b = b[border:-border, border:-border]
+    d = np.abs(a.astype(np.int16) - b.astype(np.int16))
+    return int(d.max()), float(d.mean())
+
+
+def exceeds(d: tuple, tolerance: tuple) -> bool:
+    return d[0] > tolerance[0] or d[1] > tolerance[1]
+
+
+def golden(path: str, out: np.ndarray, update: bool) -> np.ndarray:
+    if update:
+        cv2.imwrite(path, out)
+    img = cv2.imread(path)
+    if img is None:
+        print(f"Error: missing golden {path}, run with --update-golden")
+        sys.exit(1)
+    return img
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--width", type=int, default=96, help="Width of the corpus images."
+    )
+    parser.add_argument(
+        "--effect", action="append", choices=EFFECTS, help="Only run these effects."
+    )
+    parser.add_argument(
+        "--perf",
+        default=False,
+        help="Print the C filters' hardware counter reports.",
+        action=argparse.BooleanOptionalAction,
+    )
+    parser.add_argument(
+        "--update-golden",
+        default=False,
+        help="Regenerate the stored goldens from both implementations.",
+        action=argparse.BooleanOptionalAction,
+    )
+    args = parser.parse_args()
+
+    images = corpus(args.width)
+    os.makedirs(GOLDEN_DIR, exist_ok=True)
+    failed = False
+
+    with tempfile.TemporaryDirectory() as bin_dir:
+        build(bin_dir)
+
+        print(f"{'effect':<18}{'image':<10}{'py max/mean':>14}{'c max/mean':>14}{'py-c max/mean':>16}{'speedup':>10}")
+        for name in args.effect or EFFECTS:
+            py_fn, (c_filter, *c_args), cross_tol, border = EFFECTS[name]
+            for img_name, img in images.items():
+                start = time.perf_counter()
+                py_out = py_fn(img)
+                py_time = time.perf_counter() - start
+                c_out, c_time, report = run_c([os.path.join(bin_dir, c_filter), *c_args], img)
+                if args.perf:
+                    print(report, end="")
+
+                golden_path = os.path.join(GOLDEN_DIR, f"{name}_{img_name}_{args.width}")
+                py_diff = diff(py_out, golden(golden_path + ".png", py_out, args.update_golden))
+                c_diff = diff(c_out, golden(golden_path + "_c.png", c_out, args.update_golden))
+                cross = diff(py_out, c_out, border)
+                bad = (
+                    exceeds(py_diff, GOLDEN_TOLERANCE)
+                    or exceeds(c_diff, GOLDEN_TOLERANCE)
+                    or exceeds(cross, cross_tol)
+                )
+                failed |= bad
+
+                print(
+                    f"{name:<18}{img_name:<10}"
+                    f"{py_diff[0]:>8}/{py_diff[1]:<5.2f}"
+                    f"{c_diff[0]:>8}/{c_diff[1]:<5.2f}"
+                    f"{cross[0]:>10}/{cross[1]:<5.2f}"
+                    f"{py_time / max(c_time, 1e-9):>9.1f}x"
+                    + ("  FAIL" if bad else "")
+                )
+
+    sys.exit(1 if failed else 0)
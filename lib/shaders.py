@@ -70,12 +70,14 @@ def tommy_dither(img: np.ndarray) -> np.ndarray:
                     img[y + 1, x + 1] += error * 1 / 16
     return new_img
 
-def kuwahara(img: np.ndarray, ksize: int = 3) -> np.ndarray:
+def kuwahara(img: np.ndarray, ksize: int = 3, by_variance: bool = False) -> np.ndarray:
     """
     Apply Kuwahara filter to an image.
     
     :param src: Input image
     :param ksize: Size of the kernel. Must be odd and greater than 1.
+    :param by_variance: Pick the quadrant with the lowest mean variance, as video/kuwahara.c does,
+        instead of the lowest mean standard deviation.
     :return: Filtered image
     """
     h, w = img.shape[:2]
@@ -98,7 +100,7 @@ def kuwahara(img: np.ndarray, ksize: int = 3) -> np.ndarray:
                 y1, x1 = r1
                 y2, x2 = r2
                 mean, var = cv2.meanStdDev(img_pad[y1:y2, x1:x2])
-                avg_var = var.mean()
+                avg_var = (var ** 2).mean() if by_variance else var.mean()
                 if avg_var < min_var:
                     min_var = avg_var
                     new_img[y, x] = mean.astype(np.uint8).reshape(3,)
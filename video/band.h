@@ -0,0 +1,69 @@
+// Row-band streaming (--stream). Instead of reading a whole frame, filtering
+// it and writing it, the output header goes out as soon as the input header
+// is in, input rows are read a band at a time, and each band of output rows
+// is filtered and flushed once the input rows its halo reaches have arrived.
+// A stage in a live chain then holds back a few rows instead of a frame.
+#ifndef VIDEO_BAND_H
+#define VIDEO_BAND_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "deadline.h"
+#include "perf.h"
+#include "tile.h"
+
+#define BAND_ROWS TILE_H
+
+static bool band_enabled(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stream") == 0)
+      return true;
+  }
+  return false;
+}
+
+// Filter one frame whose header has already been read from stdin and written
+// to stdout. halo is how many rows below an output row the kernel reads.
+// Returns false if the input ends mid-frame; the missing rows are zeroed so
+// the frame that was announced is still written in full.
+static bool band_stream(unsigned char src[], unsigned char dst[], int width, int height, int channels, int halo, filter_fn fn, int param, struct perf *perf) {
+  size_t stride = (size_t)width * channels;
+  int rows_in = 0;
+  int rows_out = 0;
+  bool ok = true;
+
+  while (rows_out < height) {
+    int n = BAND_ROWS < height - rows_in ? BAND_ROWS : height - rows_in;
+    if (n > 0) {
+      size_t got = fread(&src[rows_in * stride], stride, n, stdin);
+      if (got < (size_t)n) {
+        memset(&src[(rows_in + got) * stride], 0, (height - rows_in - got) * stride);
+        n = height - rows_in;
+        ok = false;
+      }
+      rows_in += n;
+    }
+
+    int ready = rows_in == height ? height : rows_in - halo;
+    if (ready > rows_out) {
+      tile_row0 = rows_out;
+      tile_row1 = ready;
+      perf_begin(perf);
+      fn(src, dst, width, height, channels, param);
+      perf_end(perf, (size_t)(ready - rows_out) * width, 2 * (ready - rows_out) * stride);
+
+      fwrite(&dst[rows_out * stride], stride, ready - rows_out, stdout);
+      fflush(stdout);
+      rows_out = ready;
+    }
+  }
+
+  tile_row0 = 0;
+  tile_row1 = INT_MAX;
+  return ok;
+}
+
+#endif
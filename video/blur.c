@@ -3,79 +3,160 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "band.h"
+#include "blur.h"
+#include "deadline.h"
+#include "framestore.h"
+#include "perf.h"
+#include "roi.h"
+
 struct frame {
   size_t width;
   size_t height;
+  size_t channels;
   unsigned char data[];
 };
 
-static struct frame * frame_create(size_t width, size_t height) {
-  struct frame *f = malloc(sizeof(*f) + width * height * 3);
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
   f->width = width;
   f->height = height;
+  f->channels = channels;
   return f;
 }
 
+// P5 (greymap) for single-channel frames, P6 otherwise
+static void frame_write_header(struct frame *f) {
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+}
+
 static void frame_write(struct frame *f) {
-  printf("P6\n%zu %zu\n255\n", f->width, f->height);
-  fwrite(f->data, f->width*f->height, 3, stdout);
+  frame_write_header(f);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
 }
 
-static struct frame * frame_read(struct frame *f) {
-  size_t width, height;
-  if (scanf("P6 %zu%zu%*d%*c", &width, &height) < 2) {
+// reads the header and sizes f, leaving the pixels on stdin
+static struct frame * frame_read_header(struct frame *f) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
     free(f);
     return 0;
   }
+  channels = magic == 5 ? 1 : 3;
 
-  if (!f || f->width != width || f->height != height) {
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
     free(f);
-    f = frame_create(width, height);
+    f = frame_create(width, height, channels);
   }
-  fread(f->data, width * height, 3, stdin);
   return f;
 }
 
-void blur(unsigned char data[], int width, int height) {
-  unsigned char* tmp = (unsigned char*)malloc(height * width * 3 * sizeof(unsigned char));
-
-  for (int x = 0; x < height; x++) {
-    for (int y = 0; y < width; y++) {
-      int nPixels, avgR, avgG, avgB;
-      nPixels = avgR = avgG = avgB = 0;
-      
-      for (int i = -2; i < 3; i++) {
-        for (int j =-2; j < 3; j++) {
-          if ((x+i) >= 0 && (x+i) < height && (y+j) >= 0 && (y+j) < width) {
-            int idx = ((x+i) * width + (y+j)) * 3;
-            avgR += data[idx];
-            avgG += data[idx+1];
-            avgB += data[idx+2];
-            nPixels++;
-          }
-        }
-      }
-
-      int idx = (x * width + y) * 3;
-      tmp[idx]   = (unsigned char)(avgR / nPixels);
-      tmp[idx+1] = (unsigned char)(avgG / nPixels);
-      tmp[idx+2] = (unsigned char)(avgB / nPixels);
-    }
-  }
+static struct frame * frame_read(struct frame *f) {
+  if ((f = frame_read_header(f)))
+    fread(f->data, f->width * f->height, f->channels, stdin);
+  return f;
+}
 
-  memcpy(data, tmp, height * width * 3 * sizeof(unsigned char));
-  free(tmp);
+// (re)allocate out to the shape of f, reusing it when it already matches
+static struct frame * frame_like(struct frame *out, struct frame *f) {
+  if (!out || out->width != f->width || out->height != f->height || out->channels != f->channels) {
+    free(out);
+    out = frame_create(f->width, f->height, f->channels);
+  }
+  return out;
 }
 
+// quality levels for --fps, cheapest last
+static const struct quality levels[] = {
+  {2, false},
+  {1, false},
+  {1, true},
+};
+
 int main(int argc, char *argv[])
 {
+  struct deadline d;
+  deadline_init(&d, deadline_parse_fps(argc, argv), levels, sizeof(levels) / sizeof(levels[0]));
+
+  struct roi roi;
+  if (!roi_init(&roi, argc, argv))
+    return 1;
+
+  struct perf perf;
+  perf_init(&perf, "blur", argc, argv);
+
+  // --store filters a frame range straight out of the mapped store
+  const char *path;
+  size_t first, last;
+  if (!store_parse(argc, argv, &path, &first, &last))
+    return 1;
+  if (path) {
+    struct store s;
+    if (!store_open(&s, path))
+      return 1;
+    if (!store_check_range(&s, first)) {
+      store_close(&s);
+      return 1;
+    }
+    store_prefetch(&s, first, last);
+    roi_skip(&roi, first);
+    struct frame *out = frame_create(s.width, s.height, s.channels);
+    for (size_t i = first; i <= last && i < s.count; i++) {
+      roi_next(&roi);
+      perf_begin(&perf);
+      deadline_run(&d, blur, store_frame(&s, i), out->data, out->width, out->height, out->channels);
+      perf_end(&perf, out->width * out->height, 2 * out->width * out->height * out->channels);
+      frame_write(out);
+    }
+    deadline_finish(&d);
+    perf_report(&perf);
+    roi_close(&roi);
+    store_close(&s);
+    free(out);
+    return 0;
+  }
+
+  // --stream writes each band of rows as soon as the rows it needs are in
+  if (band_enabled(argc, argv)) {
+    struct frame *out = 0;
+    struct frame *f = 0;
+    while ((f = frame_read_header(f))) {
+      out = frame_like(out, f);
+      roi_next(&roi);
+      frame_write_header(out);
+      if (!band_stream(f->data, out->data, f->width, f->height, f->channels, levels[0].param, blur, levels[0].param, &perf))
+        break;
+    }
+    perf_report(&perf);
+    roi_close(&roi);
+    free(out);
+    free(f);
+    return 0;
+  }
+
+  struct frame *out = 0;
   struct frame *f = frame_read(0);
+  roi_skip(&roi, 1);
 
   while ((f = frame_read(f))) {
-    blur(f->data, f->width, f->height);
+    out = frame_like(out, f);
+    roi_next(&roi);
+    perf_begin(&perf);
+    deadline_run(&d, blur, f->data, out->data, f->width, f->height, f->channels);
+    perf_end(&perf, f->width * f->height, 2 * f->width * f->height * f->channels);
+
+    // the old input becomes the next frame's output buffer
+    struct frame *tmp = f;
+    f = out;
+    out = tmp;
     frame_write(f);
   }
 
+  deadline_finish(&d);
+  perf_report(&perf);
+  roi_close(&roi);
+  free(out);
   free(f);
 }
 
@@ -0,0 +1,61 @@
+// Box blur kernel, shared by ./blur and ./filterd
+#ifndef VIDEO_BLUR_H
+#define VIDEO_BLUR_H
+
+#include "tile.h"
+
+// largest radius filterd accepts from a client
+#define BLUR_MAX_RADIUS 64
+
+// One tile of a box blur, done separably: each source row of the tile plus
+// its halo is summed horizontally into scratch, then the row sums are summed
+// vertically. Windows are clipped at the frame edge and averaged over the
+// pixels they actually cover.
+static void blur_tile(const unsigned char src[], unsigned char dst[], int width, int height, int channels, struct tile t, int radius) {
+  int y0 = t.y0 - radius < 0 ? 0 : t.y0 - radius;
+  int y1 = t.y1 + radius > height ? height : t.y1 + radius;
+  int tw = t.x1 - t.x0;
+  int *rows = tile_scratch((size_t)(y1 - y0) * tw * channels * sizeof(int));
+
+  for (int y = y0; y < y1; y++) {
+    for (int x = t.x0; x < t.x1; x++) {
+      int j0 = x - radius < 0 ? 0 : x - radius;
+      int j1 = x + radius >= width ? width - 1 : x + radius;
+      int *sum = &rows[((y - y0) * tw + x - t.x0) * channels];
+      for (int c = 0; c < channels; c++)
+        sum[c] = 0;
+      for (int j = j0; j <= j1; j++) {
+        const unsigned char *p = &src[(y * width + j) * channels];
+        for (int c = 0; c < channels; c++)
+          sum[c] += p[c];
+      }
+    }
+  }
+
+  for (int y = t.y0; y < t.y1; y++) {
+    int i0 = y - radius < 0 ? 0 : y - radius;
+    int i1 = y + radius >= height ? height - 1 : y + radius;
+    for (int x = t.x0; x < t.x1; x++) {
+      int j0 = x - radius < 0 ? 0 : x - radius;
+      int j1 = x + radius >= width ? width - 1 : x + radius;
+      int nPixels = (i1 - i0 + 1) * (j1 - j0 + 1);
+      int avg[3] = {0, 0, 0};
+
+      for (int i = i0; i <= i1; i++) {
+        const int *sum = &rows[((i - y0) * tw + x - t.x0) * channels];
+        for (int c = 0; c < channels; c++)
+          avg[c] += sum[c];
+      }
+
+      int idx = (y * width + x) * channels;
+      for (int c = 0; c < channels; c++)
+        dst[idx+c] = (unsigned char)(avg[c] / nPixels);
+    }
+  }
+}
+
+static void blur(const unsigned char src[], unsigned char dst[], int width, int height, int channels, int radius) {
+  tile_run(src, dst, width, height, channels, blur_tile, radius);
+}
+
+#endif
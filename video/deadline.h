@@ -0,0 +1,215 @@
+// Real-time deadline mode: time each frame's compute against a target fps
+// and step down through a list of cheaper quality levels when behind.
+// Passing one level past the end of the list re-emits the previous output.
+// Re-emitted frames cost nothing to measure, so at that level a real frame
+// is retried at doubling intervals, and the level only steps back up once
+// the cheapest real level fits the budget again.
+#ifndef VIDEO_DEADLINE_H
+#define VIDEO_DEADLINE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tile.h"
+
+#define DEADLINE_HOLD 8        // calm frames before stepping quality back up
+#define DEADLINE_HEADROOM 0.5  // fraction of the budget that counts as calm
+#define DEADLINE_MAX_RETRY 256  // most re-emitted frames between real retries
+
+struct quality {
+  int param;  // kernel size / radius handed to the filter
+  bool half;  // run on a 2x downsampled copy
+};
+
+typedef void (*filter_fn)(const unsigned char src[], unsigned char dst[], int width, int height, int channels, int param);
+
+struct deadline {
+  double budget;  // seconds per frame, 0 disables the mode
+  const struct quality *levels;
+  int nlevels;
+  int level;
+  int calm;
+  long frames;   // real frames, the ones that count towards the miss rate
+  long misses;
+  long repeats;  // frames re-emitted instead of computed
+  double floor_cost;  // last time taken by the cheapest real level
+  int retry_wait;     // re-emits left before the next real retry
+  int retry_interval;
+  unsigned char *prev;
+  size_t prev_size;
+  unsigned char *small[2];
+  size_t small_size;
+};
+
+static void deadline_init(struct deadline *d, double fps, const struct quality levels[], int nlevels) {
+  memset(d, 0, sizeof(*d));
+  d->budget = fps > 0 ? 1.0 / fps : 0;
+  d->levels = levels;
+  d->nlevels = nlevels;
+}
+
+static double deadline_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double deadline_miss_rate(struct deadline *d) {
+  return d->frames ? 100.0 * d->misses / d->frames : 0;
+}
+
+static void deadline_log(struct deadline *d, double elapsed, int from) {
+  fprintf(stderr, "deadline: frame %ld took %.1f ms (budget %.1f ms), quality %d -> %d, %.1f%% missed\n",
+          d->frames, elapsed * 1e3, d->budget * 1e3, from, d->level, deadline_miss_rate(d));
+}
+
+static void deadline_update(struct deadline *d, double elapsed) {
+  d->frames++;
+  if (d->level >= d->nlevels - 1)
+    d->floor_cost = elapsed;
+
+  if (d->level == d->nlevels) {
+    // a retry while re-emitting: step up only if the cheapest level fits now
+    if (elapsed > d->budget)
+      d->misses++;
+    if (d->floor_cost <= d->budget) {
+      d->calm = 0;
+      d->level--;
+      deadline_log(d, elapsed, d->level + 1);
+    } else {
+      d->retry_interval = d->retry_interval * 2 < DEADLINE_MAX_RETRY ? d->retry_interval * 2 : DEADLINE_MAX_RETRY;
+      d->retry_wait = d->retry_interval;
+    }
+  } else if (elapsed > d->budget) {
+    d->misses++;
+    d->calm = 0;
+    if (++d->level == d->nlevels) {
+      d->retry_interval = DEADLINE_HOLD;
+      d->retry_wait = DEADLINE_HOLD;
+    }
+    deadline_log(d, elapsed, d->level - 1);
+  } else if (elapsed < d->budget * DEADLINE_HEADROOM) {
+    if (++d->calm >= DEADLINE_HOLD && d->level > 0) {
+      d->calm = 0;
+      d->level--;
+      deadline_log(d, elapsed, d->level + 1);
+    }
+  } else {
+    d->calm = 0;
+  }
+}
+
+// box-average down by 2, filter the small copy, scale back up nearest-neighbour
+static void deadline_half(struct deadline *d, filter_fn fn, const unsigned char src[], unsigned char dst[], int width, int height, int channels, int param) {
+  int sw = (width + 1) / 2;
+  int sh = (height + 1) / 2;
+  size_t size = (size_t)sw * sh * channels;
+  if (d->small_size < size) {
+    for (int i = 0; i < 2; i++) {
+      free(d->small[i]);
+      d->small[i] = malloc(size);
+    }
+    d->small_size = size;
+  }
+
+  for (int y = 0; y < sh; y++) {
+    for (int x = 0; x < sw; x++) {
+      for (int c = 0; c < channels; c++) {
+        int sum = 0, n = 0;
+        for (int i = 2*y; i < 2*y + 2 && i < height; i++) {
+          for (int j = 2*x; j < 2*x + 2 && j < width; j++) {
+            sum += src[(i * width + j) * channels + c];
+            n++;
+          }
+        }
+        d->small[0][(y * sw + x) * channels + c] = (unsigned char)(sum / n);
+      }
+    }
+  }
+
+  // regions of interest are in full-resolution coordinates, so halve them
+  // for the small pass and only scale back up inside them
+  struct tile full[TILE_MAX_ROI];
+  int nroi = tile_roi_count;
+  for (int i = 0; i < nroi; i++) {
+    full[i] = tile_clip(tile_roi[i], width, height);
+    tile_roi[i] = (struct tile){full[i].x0 / 2, full[i].y0 / 2, (full[i].x1 + 1) / 2, (full[i].y1 + 1) / 2};
+  }
+
+  fn(d->small[0], d->small[1], sw, sh, channels, param);
+
+  if (nroi < 0) {
+    full[0] = (struct tile){0, 0, width, height};
+    nroi = 1;
+  } else {
+    memcpy(tile_roi, full, nroi * sizeof(full[0]));
+    memcpy(dst, src, (size_t)width * height * channels);
+  }
+  for (int i = 0; i < nroi; i++) {
+    for (int y = full[i].y0; y < full[i].y1; y++) {
+      for (int x = full[i].x0; x < full[i].x1; x++) {
+        memcpy(&dst[(y * width + x) * channels], &d->small[1][((y/2) * sw + x/2) * channels], channels);
+      }
+    }
+  }
+}
+
+// Filter src into dst at the current quality level and adapt the level to
+// how long it took.
+static void deadline_run(struct deadline *d, filter_fn fn, const unsigned char src[], unsigned char dst[], int width, int height, int channels) {
+  if (d->budget == 0) {
+    fn(src, dst, width, height, channels, d->levels[0].param);
+    return;
+  }
+
+  size_t size = (size_t)width * height * channels;
+  if (d->level == d->nlevels && d->prev_size == size && d->retry_wait > 0) {
+    // neither timed nor counted, so it can't pass for a calm or on-time frame
+    memcpy(dst, d->prev, size);
+    d->retry_wait--;
+    d->repeats++;
+    return;
+  }
+
+  double start = deadline_now();
+  struct quality q = d->levels[d->level < d->nlevels ? d->level : d->nlevels - 1];
+  if (q.half) {
+    deadline_half(d, fn, src, dst, width, height, channels, q.param);
+  } else {
+    fn(src, dst, width, height, channels, q.param);
+  }
+  double elapsed = deadline_now() - start;
+
+  if (d->prev_size != size) {
+    free(d->prev);
+    d->prev = malloc(size);
+    d->prev_size = size;
+  }
+  memcpy(d->prev, dst, size);
+
+  deadline_update(d, elapsed);
+}
+
+static void deadline_finish(struct deadline *d) {
+  if (d->budget > 0) {
+    fprintf(stderr, "deadline: %ld/%ld frames missed (%.1f%%), %ld re-emitted, final quality %d\n",
+            d->misses, d->frames, deadline_miss_rate(d), d->repeats, d->level);
+  }
+  free(d->prev);
+  free(d->small[0]);
+  free(d->small[1]);
+}
+
+// --fps N enables the mode; anything else leaves it off
+static double deadline_parse_fps(int argc, char *argv[]) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--fps") == 0)
+      return atof(argv[i + 1]);
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+// Ordered dither kernels, shared by ./dither, ./dither2 and ./filterd
+#ifndef VIDEO_DITHER_H
+#define VIDEO_DITHER_H
+
+#include <stdbool.h>
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+// Bayer matrices; ./dither uses the 4x4, ./dither2 the 2x2
+static const int bayer4[4][4] = {
+  {0, 8, 2, 10},
+  {12, 4, 14, 6},
+  {3, 11, 1, 9},
+  {15, 7, 13, 5}
+};
+
+static const int bayer2[2][2] = {
+  {0, 2},
+  {3, 1}
+};
+
+// The n x n Bayer matrix scaled to offsets in 0-255. Only n = 2 and n = 4
+// have a matrix; anything else returns false and leaves offset alone.
+static inline bool dither_offsets(int n, int offset[4][4]) {
+  if (n != 2 && n != 4)
+    return false;
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      offset[i][j] = (int)((n == 4 ? bayer4[i][j] : bayer2[i][j]) / (double)(n * n) * 255);
+  return true;
+}
+
+// n is the matrix size, 2 or 4; any other n leaves data untouched
+static inline void ordered_dither(unsigned char data[], int width, int height, int channels, int n) {
+  int offset[4][4];
+  if (!dither_offsets(n, offset))
+    return;
+
+  // pointwise, so it runs in place, walking rows in memory order
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < channels; c++) {
+        int idx = (y * width + x) * channels + c;
+        int old = data[idx];
+        int new = MIN(255, old + offset[y%n][x%n]);
+        data[idx] = (unsigned char)new;
+      }
+    }
+  }
+}
+
+#endif
@@ -3,73 +3,61 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MIN(a,b) (((a)<(b))?(a):(b))
+#include "dither.h"
+#include "perf.h"
 
 struct frame {
   size_t width;
   size_t height;
+  size_t channels;
   unsigned char data[];
 };
 
-static struct frame * frame_create(size_t width, size_t height) {
-  struct frame *f = malloc(sizeof(*f) + width * height * 3);
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
   f->width = width;
   f->height = height;
+  f->channels = channels;
   return f;
 }
 
+// P5 (greymap) for single-channel frames, P6 otherwise
 static void frame_write(struct frame *f) {
-  printf("P6\n%zu %zu\n255\n", f->width, f->height);
-  fwrite(f->data, f->width*f->height, 3, stdout);
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
 }
 
 static struct frame * frame_read(struct frame *f) {
-  size_t width, height;
-  if (scanf("P6 %zu%zu%*d%*c", &width, &height) < 2) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
     free(f);
     return 0;
   }
+  channels = magic == 5 ? 1 : 3;
 
-  if (!f || f->width != width || f->height != height) {
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
     free(f);
-    f = frame_create(width, height);
+    f = frame_create(width, height, channels);
   }
-  fread(f->data, width * height, 3, stdin);
+  fread(f->data, width * height, channels, stdin);
   return f;
 }
 
-void blur(unsigned char data[], int width, int height) {
-  unsigned char* tmp = (unsigned char*)malloc(height * width * 3 * sizeof(unsigned char));
-
-  double M[2][2] = {
-    {0.0/4, 2.0/4},
-    {3.0/4, 1.0/4}
-  };
-
-  for (int x = 0; x < width; x++) {
-    for (int y = 0; y < height; y++) {
-      for (int c = 0; c < 3; c++) {
-        int idx = (y * width + x) * 3 + c;
-        int old = data[idx];
-        int new = MIN(255, old + (int)(M[y%2][x%2]*255));
-        tmp[idx] = (unsigned char)new;
-      }
-    }
-  }
-
-  memcpy(data, tmp, height * width * 3 * sizeof(unsigned char));
-  free(tmp);
-}
-
 int main(int argc, char *argv[])
 {
+  struct perf perf;
+  perf_init(&perf, "dither2", argc, argv);
   struct frame *f = frame_read(0);
 
   while ((f = frame_read(f))) {
-    blur(f->data, f->width, f->height);
+    perf_begin(&perf);
+    ordered_dither(f->data, f->width, f->height, f->channels, 2);
+    perf_end(&perf, f->width * f->height, 2 * f->width * f->height * f->channels);
     frame_write(f);
   }
 
+  perf_report(&perf);
   free(f);
 }
 
@@ -0,0 +1,590 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blur.h"
+#include "dither.h"
+#include "kuwahara.h"
+
+// Long-running filter daemon. Streams connect over a Unix domain socket, send
+// their filter chain as one line, get back "ok" (or "error ...") and then
+// stream PPM/PGM frames both ways. Frames from every stream run on one fixed
+// work-stealing pool; each stream's frames are written back in order.
+//
+//   ./filterd --listen /tmp/filterd.sock [--threads N]
+//   ./filterd --connect /tmp/filterd.sock "kuwahara:7 blur:2" < in > out
+//   ./filterd --stats /tmp/filterd.sock
+
+#define MAX_STAGES 16
+#define STREAM_WINDOW 4  // frames in flight per stream, so one busy stream can't crowd out the rest
+#define FRAME_MAX_SIDE 16384             // widest or tallest frame a client may send
+#define FRAME_MAX_BYTES ((size_t)1 << 28)  // and its largest size in bytes
+
+struct frame {
+  size_t width;
+  size_t height;
+  size_t channels;
+  unsigned char data[];
+};
+
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
+  if (!f)
+    return 0;
+  f->width = width;
+  f->height = height;
+  f->channels = channels;
+  return f;
+}
+
+// P5 (greymap) for single-channel frames, P6 otherwise
+static void frame_write(FILE *out, struct frame *f) {
+  fprintf(out, "P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, out);
+}
+
+// Returns 0 at the end of the stream, or with *error set when the client sent
+// a frame the daemon won't take, so only that stream ends.
+static struct frame * frame_read(FILE *in, struct frame *f, const char **error) {
+  int magic;
+  size_t width, height, channels;
+  *error = 0;
+  if (fscanf(in, "P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
+    free(f);
+    return 0;
+  }
+  channels = magic == 5 ? 1 : 3;
+  if (width == 0 || height == 0 || width > FRAME_MAX_SIDE || height > FRAME_MAX_SIDE ||
+      width * height * channels > FRAME_MAX_BYTES) {
+    *error = "frame size out of range";
+    free(f);
+    return 0;
+  }
+
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
+    free(f);
+    if (!(f = frame_create(width, height, channels))) {
+      *error = "out of memory";
+      return 0;
+    }
+  }
+  if (fread(f->data, width * height, channels, in) != channels) {
+    free(f);
+    return 0;
+  }
+  return f;
+}
+
+// (re)allocate out to the shape of f, reusing it when it already matches
+static struct frame * frame_like(struct frame *out, struct frame *f) {
+  if (!out || out->width != f->width || out->height != f->height || out->channels != f->channels) {
+    free(out);
+    out = frame_create(f->width, f->height, f->channels);
+  }
+  return out;
+}
+
+// Filters a chain can use. Neighbourhood filters go src -> dst, pointwise
+// ones run in place. A client's "name:param" must lie in [min, max].
+struct filter {
+  const char *name;
+  int param;
+  int min;
+  int max;
+  void (*fn)(const unsigned char src[], unsigned char dst[], int width, int height, int channels, int param);
+  void (*inplace)(unsigned char data[], int width, int height, int channels, int param);
+};
+
+static const struct filter filters[] = {
+  {"blur", 2, 1, BLUR_MAX_RADIUS, blur, 0},
+  {"kuwahara", 7, 1, KUWAHARA_MAX_KSIZE, kuwahara, 0},
+  {"dither", 4, 4, 4, 0, ordered_dither},
+  {"dither2", 2, 2, 2, 0, ordered_dither},
+};
+
+struct stage {
+  const struct filter *filter;
+  int param;
+};
+
+struct slot {
+  struct frame *in;
+  struct frame *out;
+  struct frame *result;  // whichever of in/out holds the finished frame
+  bool done;
+};
+
+struct stream {
+  int id;
+  FILE *rx;
+  FILE *tx;
+  char chain[256];
+  struct stage stages[MAX_STAGES];
+  int nstages;
+
+  // slot seq % STREAM_WINDOW belongs to frame seq while next_out <= seq < next_in
+  struct slot slots[STREAM_WINDOW];
+  long next_in;
+  long next_out;
+  bool eof;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  double started;
+  struct stream *next;
+};
+
+struct job {
+  struct stream *s;
+  long seq;
+};
+
+// Per-worker deque: the owner takes from the head, thieves from the tail.
+struct deque {
+  pthread_mutex_t lock;
+  struct job *jobs;
+  size_t cap;
+  size_t head;
+  size_t len;
+};
+
+static struct {
+  int nworkers;
+  struct deque *queues;
+  unsigned next;  // round-robin submission target
+  atomic_long pending;  // jobs sitting in the deques, counted under the deque lock with the job
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+static struct {
+  struct stream *head;
+  int next_id;
+  pthread_mutex_t lock;
+} streams = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void deque_push(struct deque *q, struct job j) {
+  pthread_mutex_lock(&q->lock);
+  if (q->len == q->cap) {
+    size_t cap = q->cap ? q->cap * 2 : 64;
+    struct job *jobs = malloc(cap * sizeof(*jobs));
+    for (size_t i = 0; i < q->len; i++)
+      jobs[i] = q->jobs[(q->head + i) % q->cap];
+    free(q->jobs);
+    q->jobs = jobs;
+    q->cap = cap;
+    q->head = 0;
+  }
+  q->jobs[(q->head + q->len) % q->cap] = j;
+  q->len++;
+  atomic_fetch_add(&pool.pending, 1);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static bool deque_take(struct deque *q, struct job *j, bool steal) {
+  pthread_mutex_lock(&q->lock);
+  bool ok = q->len > 0;
+  if (ok) {
+    if (steal) {
+      *j = q->jobs[(q->head + q->len - 1) % q->cap];
+    } else {
+      *j = q->jobs[q->head];
+      q->head = (q->head + 1) % q->cap;
+    }
+    q->len--;
+    atomic_fetch_sub(&pool.pending, 1);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return ok;
+}
+
+static void pool_submit(struct stream *s, long seq) {
+  pthread_mutex_lock(&pool.lock);
+  unsigned target = pool.next++ % pool.nworkers;
+  pthread_mutex_unlock(&pool.lock);
+
+  deque_push(&pool.queues[target], (struct job){s, seq});
+
+  // signalling under the lock means a worker that just saw pending == 0 is
+  // already waiting and gets the wakeup
+  pthread_mutex_lock(&pool.lock);
+  pthread_cond_signal(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+// Run a stream's whole chain over one frame.
+static void run(struct job j) {
+  struct stream *s = j.s;
+  struct slot *slot = &s->slots[j.seq % STREAM_WINDOW];
+  struct frame *src = slot->in;
+  struct frame *dst = slot->out;
+
+  for (int i = 0; i < s->nstages; i++) {
+    const struct filter *f = s->stages[i].filter;
+    if (f->inplace) {
+      f->inplace(src->data, src->width, src->height, src->channels, s->stages[i].param);
+    } else {
+      f->fn(src->data, dst->data, src->width, src->height, src->channels, s->stages[i].param);
+      struct frame *tmp = src;
+      src = dst;
+      dst = tmp;
+    }
+  }
+
+  pthread_mutex_lock(&s->lock);
+  slot->result = src;
+  slot->done = true;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+}
+
+static void * worker(void *arg) {
+  int self = (int)(intptr_t)arg;
+  for (;;) {
+    struct job j;
+    bool found = deque_take(&pool.queues[self], &j, false);
+    for (int i = 1; !found && i < pool.nworkers; i++)
+      found = deque_take(&pool.queues[(self + i) % pool.nworkers], &j, true);
+
+    if (found) {
+      run(j);
+    } else {
+      pthread_mutex_lock(&pool.lock);
+      while (atomic_load(&pool.pending) == 0)
+        pthread_cond_wait(&pool.wake, &pool.lock);
+      pthread_mutex_unlock(&pool.lock);
+    }
+  }
+  return 0;
+}
+
+// "blur:2 kuwahara" -> stages; returns false and names the bad token otherwise
+static bool parse_chain(struct stream *s, char *line, char *error, size_t n) {
+  char *save;
+  snprintf(s->chain, sizeof(s->chain), "%s", line);
+  for (char *tok = strtok_r(line, " \t", &save); tok; tok = strtok_r(0, " \t", &save)) {
+    char *colon = strchr(tok, ':');
+    if (colon)
+      *colon = 0;
+
+    const struct filter *f = 0;
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+      if (strcmp(filters[i].name, tok) == 0)
+        f = &filters[i];
+    }
+    if (!f || s->nstages == MAX_STAGES) {
+      snprintf(error, n, "unknown filter or chain too long: %s", tok);
+      return false;
+    }
+
+    int param = f->param;
+    if (colon) {
+      char *end;
+      long v = strtol(colon + 1, &end, 10);
+      if (end == colon + 1 || *end || v < f->min || v > f->max) {
+        if (f->min == f->max)
+          snprintf(error, n, "bad parameter for %s: %s (only %d)", tok, colon + 1, f->min);
+        else
+          snprintf(error, n, "bad parameter for %s: %s (expected %d-%d)", tok, colon + 1, f->min, f->max);
+        return false;
+      }
+      param = (int)v;
+    }
+
+    s->stages[s->nstages].filter = f;
+    s->stages[s->nstages].param = param;
+    s->nstages++;
+  }
+  if (s->nstages == 0) {
+    snprintf(error, n, "empty filter chain");
+    return false;
+  }
+  return true;
+}
+
+static void write_stats(FILE *out) {
+  pthread_mutex_lock(&streams.lock);
+  fprintf(out, "%d workers\n", pool.nworkers);
+  fprintf(out, "%-6s %-10s %-10s %-6s %s\n", "stream", "frames", "fps", "queue", "chain");
+  for (struct stream *s = streams.head; s; s = s->next) {
+    pthread_mutex_lock(&s->lock);
+    double elapsed = now() - s->started;
+    fprintf(out, "%-6d %-10ld %-10.1f %-6ld %s\n", s->id, s->next_out,
+            elapsed > 0 ? s->next_out / elapsed : 0, s->next_in - s->next_out, s->chain);
+    pthread_mutex_unlock(&s->lock);
+  }
+  pthread_mutex_unlock(&streams.lock);
+}
+
+// Writes finished frames back in order; the connection thread does the reading.
+static void * stream_writer(void *arg) {
+  struct stream *s = arg;
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    while (!(s->next_out < s->next_in && s->slots[s->next_out % STREAM_WINDOW].done) &&
+           !(s->eof && s->next_out == s->next_in))
+      pthread_cond_wait(&s->cond, &s->lock);
+    if (s->eof && s->next_out == s->next_in) {
+      pthread_mutex_unlock(&s->lock);
+      break;
+    }
+    struct slot *slot = &s->slots[s->next_out % STREAM_WINDOW];
+    pthread_mutex_unlock(&s->lock);
+
+    frame_write(s->tx, slot->result);
+    fflush(s->tx);
+
+    pthread_mutex_lock(&s->lock);
+    slot->done = false;
+    s->next_out++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return 0;
+}
+
+static void * connection(void *arg) {
+  int fd = (int)(intptr_t)arg;
+  struct stream *s = calloc(1, sizeof(*s));
+  s->rx = fdopen(fd, "r");
+  s->tx = fdopen(dup(fd), "w");
+  pthread_mutex_init(&s->lock, 0);
+  pthread_cond_init(&s->cond, 0);
+
+  char line[256];
+  char error[300];
+  if (!fgets(line, sizeof(line), s->rx)) {
+    goto done;
+  }
+  line[strcspn(line, "\r\n")] = 0;
+  if (strcmp(line, "stats") == 0) {
+    write_stats(s->tx);
+    goto done;
+  }
+  if (!parse_chain(s, line, error, sizeof(error))) {
+    fprintf(s->tx, "error %s\n", error);
+    goto done;
+  }
+  fprintf(s->tx, "ok\n");
+  fflush(s->tx);
+
+  s->started = now();
+  pthread_mutex_lock(&streams.lock);
+  s->id = streams.next_id++;
+  s->next = streams.head;
+  streams.head = s;
+  pthread_mutex_unlock(&streams.lock);
+
+  pthread_t writer;
+  pthread_create(&writer, 0, stream_writer, s);
+  const char *bad = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    while (s->next_in - s->next_out >= STREAM_WINDOW)
+      pthread_cond_wait(&s->cond, &s->lock);
+    struct slot *slot = &s->slots[s->next_in % STREAM_WINDOW];
+    pthread_mutex_unlock(&s->lock);
+
+    if (!(slot->in = frame_read(s->rx, slot->in, &bad)))
+      break;
+    if (!(slot->out = frame_like(slot->out, slot->in))) {
+      bad = "out of memory";
+      break;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    long seq = s->next_in++;
+    pthread_mutex_unlock(&s->lock);
+    pool_submit(s, seq);
+  }
+
+  pthread_mutex_lock(&s->lock);
+  s->eof = true;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(writer, 0);
+
+  // after the frames already accepted, so the client sees why its stream ended
+  if (bad) {
+    fprintf(s->tx, "error %s\n", bad);
+    fprintf(stderr, "filterd: stream %d (%s) ended: %s\n", s->id, s->chain, bad);
+  }
+
+  pthread_mutex_lock(&streams.lock);
+  for (struct stream **p = &streams.head; *p; p = &(*p)->next) {
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&streams.lock);
+
+  double elapsed = now() - s->started;
+  fprintf(stderr, "filterd: stream %d (%s) done, %ld frames at %.1f fps\n",
+          s->id, s->chain, s->next_out, elapsed > 0 ? s->next_out / elapsed : 0);
+
+done:
+  for (int i = 0; i < STREAM_WINDOW; i++) {
+    free(s->slots[i].in);
+    free(s->slots[i].out);
+  }
+  fclose(s->rx);
+  fclose(s->tx);
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->cond);
+  free(s);
+  return 0;
+}
+
+static int unix_socket(const char *path, bool listening) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (listening) {
+    // only ever replace a stale socket, never whatever else the path names
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+        close(fd);
+        errno = ENOTSOCK;
+        return -1;
+      }
+      unlink(path);
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+      close(fd);
+      return -1;
+    }
+  } else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int serve(const char *path, int nworkers) {
+  int fd = unix_socket(path, true);
+  if (fd < 0) {
+    fprintf(stderr, "Error listening on %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  pool.nworkers = nworkers;
+  pool.queues = calloc(nworkers, sizeof(*pool.queues));
+  for (int i = 0; i < nworkers; i++) {
+    pthread_t t;
+    pthread_mutex_init(&pool.queues[i].lock, 0);
+    pthread_create(&t, 0, worker, (void *)(intptr_t)i);
+    pthread_detach(t);
+  }
+  fprintf(stderr, "filterd: listening on %s with %d workers\n", path, nworkers);
+
+  for (;;) {
+    int conn = accept(fd, 0, 0);
+    if (conn < 0) {
+      // out of descriptors or memory: give the streams a moment to finish
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+        usleep(100000);
+      else if (errno != EINTR && errno != ECONNABORTED) {
+        fprintf(stderr, "filterd: accept on %s failed: %s\n", path, strerror(errno));
+        return 1;
+      }
+      continue;
+    }
+    pthread_t t;
+    pthread_create(&t, 0, connection, (void *)(intptr_t)conn);
+    pthread_detach(t);
+  }
+}
+
+static void * copy_stdin(void *arg) {
+  int fd = (int)(intptr_t)arg;
+  char buf[1 << 16];
+  ssize_t n;
+  while ((n = read(0, buf, sizeof(buf))) > 0) {
+    for (ssize_t off = 0; off < n; ) {
+      ssize_t w = write(fd, buf + off, n - off);
+      if (w <= 0)
+        return 0;
+      off += w;
+    }
+  }
+  shutdown(fd, SHUT_WR);
+  return 0;
+}
+
+// Client side: send the request line, check the reply, then pipe stdin to the
+// daemon and the daemon's frames to stdout.
+static int client(const char *path, const char *request, bool frames) {
+  int fd = unix_socket(path, false);
+  if (fd < 0) {
+    fprintf(stderr, "Error connecting to %s\n", path);
+    return 1;
+  }
+  dprintf(fd, "%s\n", request);
+
+  char buf[1 << 16];
+  ssize_t n;
+  if (frames) {
+    // read the reply a byte at a time so no frame data is consumed with it
+    size_t len = 0;
+    while (len + 1 < sizeof(buf) && read(fd, &buf[len], 1) == 1 && buf[len] != '\n')
+      len++;
+    buf[len] = 0;
+    if (strcmp(buf, "ok") != 0) {
+      fprintf(stderr, "filterd: %s\n", buf);
+      return 1;
+    }
+
+    pthread_t t;
+    pthread_create(&t, 0, copy_stdin, (void *)(intptr_t)fd);
+    pthread_detach(t);
+  }
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    fwrite(buf, 1, n, stdout);
+  close(fd);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  if (argc >= 3 && strcmp(argv[1], "--listen") == 0) {
+    int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc == 5 && strcmp(argv[3], "--threads") == 0)
+      nworkers = atoi(argv[4]);
+    return serve(argv[2], nworkers > 0 ? nworkers : 1);
+  }
+  if (argc == 4 && strcmp(argv[1], "--connect") == 0)
+    return client(argv[2], argv[3], true);
+  if (argc == 3 && strcmp(argv[1], "--stats") == 0)
+    return client(argv[2], "stats", false);
+
+  fprintf(stderr, "Usage: %s --listen SOCKET [--threads N]\n", argv[0]);
+  fprintf(stderr, "       %s --connect SOCKET \"FILTER[:PARAM] ...\"\n", argv[0]);
+  fprintf(stderr, "       %s --stats SOCKET\n", argv[0]);
+  return 1;
+}
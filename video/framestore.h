@@ -0,0 +1,159 @@
+// Raw frame store: a header, fixed-stride page-aligned frames and an index of
+// frame offsets, written once by ./store and then memory-mapped read-only by
+// the filters so any frame range can be reprocessed without decoding or
+// copying. The mapping is shared and read-only, so any number of processes
+// can work on disjoint --frames ranges of the same file at once.
+#ifndef VIDEO_FRAMESTORE_H
+#define VIDEO_FRAMESTORE_H
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STORE_MAGIC "PGFXRAW1"
+#define STORE_ALIGN 4096
+
+struct store_header {
+  char magic[8];
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;
+  uint32_t reserved;
+  uint64_t count;   // number of frames
+  uint64_t stride;  // bytes between frames, a multiple of STORE_ALIGN
+  uint64_t index;   // file offset of count uint64_t frame offsets
+};
+
+struct store {
+  const unsigned char *map;
+  size_t size;
+  size_t width;
+  size_t height;
+  size_t channels;
+  size_t count;
+  const uint64_t *index;
+};
+
+static inline size_t store_stride(size_t width, size_t height, size_t channels) {
+  size_t bytes = width * height * channels;
+  return (bytes + STORE_ALIGN - 1) / STORE_ALIGN * STORE_ALIGN;
+}
+
+// Check the header, the index and every frame it points at against the file
+// size, so a truncated or corrupt store is rejected instead of faulting later.
+static inline bool store_valid(const struct store_header *h, const unsigned char *map, size_t size) {
+  if (memcmp(h->magic, STORE_MAGIC, 8) != 0 || (h->channels != 1 && h->channels != 3))
+    return false;
+  uint64_t bytes = (uint64_t)h->width * h->height * h->channels;
+  if (bytes == 0 || h->stride < bytes)
+    return false;
+  if (h->index % sizeof(uint64_t) != 0 || h->index > size || h->count > (size - h->index) / sizeof(uint64_t))
+    return false;
+
+  const uint64_t *index = (const uint64_t *)(map + h->index);
+  for (uint64_t i = 0; i < h->count; i++) {
+    if (index[i] > size || bytes > size - index[i])
+      return false;
+  }
+  return true;
+}
+
+static inline int store_open(struct store *s, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error opening frame store %s\n", path);
+    return 0;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  s->size = st.st_size;
+  s->map = s->size >= sizeof(struct store_header) ? mmap(0, s->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (s->map == MAP_FAILED) {
+    fprintf(stderr, "Error mapping frame store %s\n", path);
+    return 0;
+  }
+
+  const struct store_header *h = (const struct store_header *)s->map;
+  if (!store_valid(h, s->map, s->size)) {
+    fprintf(stderr, "Not a frame store, or truncated: %s\n", path);
+    munmap((void *)s->map, s->size);
+    return 0;
+  }
+
+  s->width = h->width;
+  s->height = h->height;
+  s->channels = h->channels;
+  s->count = h->count;
+  s->index = (const uint64_t *)(s->map + h->index);
+  return 1;
+}
+
+// After store_open: a --frames range that starts past the last frame is a
+// usage error rather than an empty run.
+static inline bool store_check_range(const struct store *s, size_t first) {
+  if (first < s->count)
+    return true;
+  fprintf(stderr, "Usage: --frames starts at frame %zu, but the store only has %zu frames\n", first, s->count);
+  return false;
+}
+
+// pixels of frame i, straight out of the mapping
+static inline const unsigned char * store_frame(struct store *s, size_t i) {
+  return s->map + s->index[i];
+}
+
+// hint the kernel to read ahead frames [first, last]
+static inline void store_prefetch(struct store *s, size_t first, size_t last) {
+  if (first >= s->count)
+    return;
+  if (last >= s->count)
+    last = s->count - 1;
+  size_t begin = s->index[first] / STORE_ALIGN * STORE_ALIGN;
+  size_t end = s->index[last] + s->width * s->height * s->channels;
+  madvise((void *)(s->map + begin), end - begin, MADV_WILLNEED);
+}
+
+static inline void store_close(struct store *s) {
+  munmap((void *)s->map, s->size);
+}
+
+// --store PATH [--frames FIRST[-LAST]]; path is 0 when --store isn't given.
+// The range is inclusive and defaults to every frame. Returns false after
+// printing a usage error for a malformed or reversed range.
+static inline bool store_parse(int argc, char *argv[], const char **path, size_t *first, size_t *last) {
+  const char *frames = 0;
+  *path = 0;
+  *first = 0;
+  *last = SIZE_MAX;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--store") == 0)
+      *path = argv[i + 1];
+    else if (strcmp(argv[i], "--frames") == 0)
+      frames = argv[i + 1];
+  }
+  if (!frames)
+    return true;
+
+  char *end = 0;
+  if (isdigit((unsigned char)frames[0])) {
+    *first = *last = strtoull(frames, &end, 10);
+    if (*end == '-' && isdigit((unsigned char)end[1]))
+      *last = strtoull(end + 1, &end, 10);
+  }
+  if (!end || *end || *first > *last || !*path) {
+    fprintf(stderr, "Usage: --store PATH [--frames FIRST[-LAST]], with FIRST <= LAST (got --frames %s)\n", frames);
+    return false;
+  }
+  return true;
+}
+
+#endif
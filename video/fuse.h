@@ -0,0 +1,177 @@
+// Fused pointwise kernels. Each op works on one pixel held in locals, and
+// FUSED() stamps out a single loop that loads a pixel once, runs a fixed
+// sequence of ops on it and stores it once, so a grey -> dither -> quantize
+// chain costs one pass over memory instead of three. The common chains are
+// instantiated below; fused_lookup() picks one by name and anything else
+// falls back to fused_generic(), which is still one pass but dispatches per op.
+#ifndef VIDEO_FUSE_H
+#define VIDEO_FUSE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dither.h"
+
+struct px {
+  unsigned char c[3];
+};
+
+static inline void px_grey(struct px *p, int channels) {
+  if (channels == 3) {
+    unsigned char grey = (unsigned char)(0.299*p->c[0] + 0.587*p->c[1] + 0.114*p->c[2]);
+    p->c[0] = p->c[1] = p->c[2] = grey;
+  }
+}
+
+// offset[] is this pixel's slice of the dither row, one byte per channel.
+// The add saturates by spotting wraparound, which keeps it in byte lanes.
+static inline void px_dither(struct px *p, int channels, const unsigned char offset[]) {
+  for (int c = 0; c < channels; c++) {
+    unsigned char v = (unsigned char)(p->c[c] + offset[c]);
+    p->c[c] = v | (unsigned char)-(v < p->c[c]);
+  }
+}
+
+// nearest of the six web-safe levels, as in shaders.to_websafe
+static inline void px_websafe(struct px *p, int channels) {
+  for (int c = 0; c < channels; c++)
+    p->c[c] = (unsigned char)((unsigned short)(p->c[c] + 25) / 51 * 51);
+}
+
+// n x n Bayer offsets, as in ordered_dither, and each of their rows expanded
+// to one offset per sample, laid out like a row of the frame, so the x loop
+// reads them in step with the pixels
+static int dither_offset[5][4][4];
+static unsigned char *dither_row[5][4];
+static int dither_row_width = -1;
+static int dither_row_channels = -1;
+
+static void fused_init(void) {
+  dither_offsets(4, dither_offset[4]);
+  dither_offsets(2, dither_offset[2]);
+}
+
+// (re)build the expanded dither rows for frames of this shape
+static void fused_prepare(int width, int channels) {
+  if (width == dither_row_width && channels == dither_row_channels)
+    return;
+  size_t samples = (size_t)width * channels;
+  for (int n = 2; n <= 4; n += 2) {
+    for (int i = 0; i < n; i++) {
+      dither_row[n][i] = realloc(dither_row[n][i], samples > 0 ? samples : 1);
+      for (size_t s = 0; s < samples; s++)
+        dither_row[n][i][s] = (unsigned char)dither_offset[n][i][s / channels % n];
+    }
+  }
+  dither_row_width = width;
+  dither_row_channels = channels;
+}
+
+typedef void (*fused_fn)(unsigned char data[], int width, int height, int channels);
+
+// OPS is a parenthesised statement list over p, x, channels and the dither
+// rows dither2/dither4 of the current y. Each chain is stamped out once per
+// channel count, so the pixel loads and stores have a fixed trip count and
+// the x loop vectorizes. Single-channel frames and chains without grey
+// vectorize on plain SSE2; grey's three-channel shuffles want SSSE3 or AVX2.
+#define FUSED_CHANNELS(name, CHANNELS, OPS) \
+  static void name(unsigned char data[], int width, int height) { \
+    const int channels = CHANNELS; \
+    fused_prepare(width, channels); \
+    for (int y = 0; y < height; y++) { \
+      unsigned char *restrict row = &data[(size_t)y * width * channels]; \
+      const unsigned char *restrict dither2 = dither_row[2][y % 2]; \
+      const unsigned char *restrict dither4 = dither_row[4][y % 4]; \
+      (void)dither2; \
+      (void)dither4; \
+      for (int x = 0; x < width; x++) { \
+        unsigned char *q = &row[x * channels]; \
+        struct px p; \
+        for (int c = 0; c < channels; c++) \
+          p.c[c] = q[c]; \
+        OPS; \
+        for (int c = 0; c < channels; c++) \
+          q[c] = p.c[c]; \
+      } \
+    } \
+  }
+
+#define FUSED(name, OPS) \
+  FUSED_CHANNELS(name##_1, 1, OPS) \
+  FUSED_CHANNELS(name##_3, 3, OPS) \
+  static void name(unsigned char data[], int width, int height, int channels) { \
+    if (channels == 1) \
+      name##_1(data, width, height); \
+    else \
+      name##_3(data, width, height); \
+  }
+
+FUSED(fused_grey_dither, (px_grey(&p, channels), px_dither(&p, channels, &dither4[x * channels])))
+FUSED(fused_grey_dither2, (px_grey(&p, channels), px_dither(&p, channels, &dither2[x * channels])))
+FUSED(fused_grey_websafe, (px_grey(&p, channels), px_websafe(&p, channels)))
+FUSED(fused_dither_websafe, (px_dither(&p, channels, &dither4[x * channels]), px_websafe(&p, channels)))
+FUSED(fused_dither2_websafe, (px_dither(&p, channels, &dither2[x * channels]), px_websafe(&p, channels)))
+FUSED(fused_grey_dither_websafe, (px_grey(&p, channels), px_dither(&p, channels, &dither4[x * channels]), px_websafe(&p, channels)))
+FUSED(fused_grey_dither2_websafe, (px_grey(&p, channels), px_dither(&p, channels, &dither2[x * channels]), px_websafe(&p, channels)))
+
+static const struct {
+  const char *chain;
+  fused_fn fn;
+} fused_chains[] = {
+  {"grey dither", fused_grey_dither},
+  {"grey dither2", fused_grey_dither2},
+  {"grey websafe", fused_grey_websafe},
+  {"dither websafe", fused_dither_websafe},
+  {"dither2 websafe", fused_dither2_websafe},
+  {"grey dither websafe", fused_grey_dither_websafe},
+  {"grey dither2 websafe", fused_grey_dither2_websafe},
+};
+
+static fused_fn fused_lookup(const char *chain) {
+  for (size_t i = 0; i < sizeof(fused_chains) / sizeof(fused_chains[0]); i++) {
+    if (strcmp(fused_chains[i].chain, chain) == 0)
+      return fused_chains[i].fn;
+  }
+  return 0;
+}
+
+enum px_op { OP_GREY, OP_DITHER, OP_DITHER2, OP_WEBSAFE };
+
+static bool fused_parse_op(const char *name, enum px_op *op) {
+  static const char *names[] = {"grey", "dither", "dither2", "websafe"};
+  for (int i = 0; i < 4; i++) {
+    if (strcmp(names[i], name) == 0) {
+      *op = (enum px_op)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// any chain of ops, one pass, switching on each op per pixel
+static void fused_generic(unsigned char data[], int width, int height, int channels, const enum px_op ops[], int nops) {
+  fused_prepare(width, channels);
+  for (int y = 0; y < height; y++) {
+    const unsigned char *dither2 = dither_row[2][y % 2];
+    const unsigned char *dither4 = dither_row[4][y % 4];
+    for (int x = 0; x < width; x++) {
+      unsigned char *q = &data[((size_t)y * width + x) * channels];
+      struct px p;
+      for (int c = 0; c < channels; c++)
+        p.c[c] = q[c];
+      for (int i = 0; i < nops; i++) {
+        switch (ops[i]) {
+        case OP_GREY: px_grey(&p, channels); break;
+        case OP_DITHER: px_dither(&p, channels, &dither4[x * channels]); break;
+        case OP_DITHER2: px_dither(&p, channels, &dither2[x * channels]); break;
+        case OP_WEBSAFE: px_websafe(&p, channels); break;
+        }
+      }
+      for (int c = 0; c < channels; c++)
+        q[c] = p.c[c];
+    }
+  }
+}
+
+#endif
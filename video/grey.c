@@ -3,36 +3,43 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "perf.h"
+
 struct frame {
   size_t width;
   size_t height;
+  size_t channels;
   unsigned char data[];
 };
 
-static struct frame * frame_create(size_t width, size_t height) {
-  struct frame *f = malloc(sizeof(*f) + width * height * 3);
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
   f->width = width;
   f->height = height;
+  f->channels = channels;
   return f;
 }
 
+// P5 (greymap) for single-channel frames, P6 otherwise
 static void frame_write(struct frame *f) {
-  printf("P6\n%zu %zu\n255\n", f->width, f->height);
-  fwrite(f->data, f->width*f->height, 3, stdout);
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
 }
 
 static struct frame * frame_read(struct frame *f) {
-  size_t width, height;
-  if (scanf("P6 %zu%zu%*d%*c", &width, &height) < 2) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
     free(f);
     return 0;
   }
+  channels = magic == 5 ? 1 : 3;
 
-  if (!f || f->width != width || f->height != height) {
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
     free(f);
-    f = frame_create(width, height);
+    f = frame_create(width, height, channels);
   }
-  fread(f->data, width * height, 3, stdin);
+  fread(f->data, width * height, channels, stdin);
   return f;
 }
 
@@ -46,16 +53,47 @@ void convert_to_grayscale(unsigned char* data, int width, int height) {
   }
 }
 
+// same luma as convert_to_grayscale, but one byte per pixel into out
+void convert_to_luma(unsigned char* out, const unsigned char* data, int width, int height) {
+  for (int i=0; i<width*height; i++) {
+    out[i] = (unsigned char)(0.299*data[i*3] + 0.587*data[i*3+1] + 0.114*data[i*3+2]);
+  }
+}
+
 int main(int argc, char *argv[])
 {
+  // --pgm emits single-channel P5 frames, a third of the bytes of P6
+  bool pgm = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--pgm") == 0)
+      pgm = true;
+  }
+  struct perf perf;
+  perf_init(&perf, "grey", argc, argv);
+  struct frame *out = 0;
   struct frame *f = frame_read(0);
 
   while ((f = frame_read(f))) {
-    convert_to_grayscale(f->data, f->width, f->height);
-    frame_write(f);
+    if (f->channels == 1) {
+      frame_write(f);
+    } else if (pgm) {
+      if (!out || out->width != f->width || out->height != f->height) {
+        free(out);
+        out = frame_create(f->width, f->height, 1);
+      }
+      perf_begin(&perf);
+      convert_to_luma(out->data, f->data, f->width, f->height);
+      perf_end(&perf, f->width * f->height, 4 * f->width * f->height);
+      frame_write(out);
+    } else {
+      perf_begin(&perf);
+      convert_to_grayscale(f->data, f->width, f->height);
+      perf_end(&perf, f->width * f->height, 6 * f->width * f->height);
+      frame_write(f);
+    }
   }
 
+  perf_report(&perf);
+  free(out);
   free(f);
 }
-
-
@@ -2,41 +2,70 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "framestore.h"
+
 struct frame {
   size_t width;
   size_t height;
+  size_t channels;
   unsigned char data[];
 };
 
-static struct frame * frame_create(size_t width, size_t height) {
-  struct frame *f = malloc(sizeof(*f) + width * height * 3);
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
   f->width = width;
   f->height = height;
+  f->channels = channels;
   return f;
 }
 
+// P5 (greymap) for single-channel frames, P6 otherwise
 static void frame_write(struct frame *f) {
-  printf("P6\n%zu %zu\n255\n", f->width, f->height);
-  fwrite(f->data, f->width*f->height, 3, stdout);
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
 }
 
 static struct frame * frame_read(struct frame *f) {
-  size_t width, height;
-  if (scanf("P6 %zu%zu%*d%*c", &width, &height) < 2) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
     free(f);
     return 0;
   }
+  channels = magic == 5 ? 1 : 3;
 
-  if (!f || f->width != width || f->height != height) {
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
     free(f);
-    f = frame_create(width, height);
+    f = frame_create(width, height, channels);
   }
-  fread(f->data, width * height, 3, stdin);
+  fread(f->data, width * height, channels, stdin);
   return f;
 }
 
 int main(int argc, char *argv[])
 {
+  // --store replays a frame range from a frame store instead of stdin
+  const char *path;
+  size_t first, last;
+  if (!store_parse(argc, argv, &path, &first, &last))
+    return 1;
+  if (path) {
+    struct store s;
+    if (!store_open(&s, path))
+      return 1;
+    if (!store_check_range(&s, first)) {
+      store_close(&s);
+      return 1;
+    }
+    store_prefetch(&s, first, last);
+    for (size_t i = first; i <= last && i < s.count; i++) {
+      printf("P%d\n%zu %zu\n255\n", s.channels == 1 ? 5 : 6, s.width, s.height);
+      fwrite(store_frame(&s, i), s.width*s.height, s.channels, stdout);
+    }
+    store_close(&s);
+    return 0;
+  }
+
   struct frame *f = 0;
   while ((f = frame_read(f)))
     frame_write(f);
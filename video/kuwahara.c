@@ -5,115 +5,182 @@
 #include <string.h>
 #include <float.h>
 
+#include "band.h"
+#include "deadline.h"
+#include "framestore.h"
+#include "kuwahara.h"
+#include "perf.h"
+#include "roi.h"
+
 struct frame {
   size_t width;
   size_t height;
+  size_t channels;
   unsigned char data[];
 };
 
-static struct frame * frame_create(size_t width, size_t height) {
-  struct frame *f = malloc(sizeof(*f) + width * height * 3);
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
   f->width = width;
   f->height = height;
+  f->channels = channels;
   return f;
 }
 
+// P5 (greymap) for single-channel frames, P6 otherwise
+static void frame_write_header(struct frame *f) {
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+}
+
 static void frame_write(struct frame *f) {
-  printf("P6\n%zu %zu\n255\n", f->width, f->height);
-  fwrite(f->data, f->width*f->height, 3, stdout);
+  frame_write_header(f);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
 }
 
-static struct frame * frame_read(struct frame *f) {
-  size_t width, height;
-  if (scanf("P6 %zu%zu%*d%*c", &width, &height) < 2) {
+// reads the header and sizes f, leaving the pixels on stdin
+static struct frame * frame_read_header(struct frame *f) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
     free(f);
     return 0;
   }
+  channels = magic == 5 ? 1 : 3;
 
-  if (!f || f->width != width || f->height != height) {
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
     free(f);
-    f = frame_create(width, height);
+    f = frame_create(width, height, channels);
   }
-  fread(f->data, width * height, 3, stdin);
   return f;
 }
 
-void kuwahara(unsigned char img[], int width, int height, int ksize) {
-    unsigned char* tmp = (unsigned char*)malloc(height * width * 3 * sizeof(unsigned char));
-    
-    int pad = ksize / 2;
-    int stride = width * 3;
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            double min_var = DBL_MAX;
-            int best_mean[3] = {0, 0, 0};
-
-            int regions[4][4] = {
-                {-pad, -pad, 0, 0},           // top left
-                {-pad, 0, 0, pad},            // top right
-                {0, -pad, pad, 0},            // bottom left
-                {0, 0, pad, pad}              // bottom right
-            };
-
-            for (int r = 0; r < 4; r++) {
-                int sum[3] = {0, 0, 0};
-                int sum_sq[3] = {0, 0, 0};
-                int count = 0;
-
-                for (int i = regions[r][0]; i <= regions[r][2]; i++) {
-                    for (int j = regions[r][1]; j <= regions[r][3]; j++) {
-                        int yi = y + i;
-                        int xj = x + j;
-                        if (yi >= 0 && yi < height && xj >= 0 && xj < width) {
-                            int idx = (yi * width + xj) * 3;
-                            for (int c = 0; c < 3; c++) {
-                                int val = img[idx + c];
-                                sum[c] += val;
-                                sum_sq[c] += val * val;
-                            }
-                            count++;
-                        }
-                    }
-                }
-
-                if (count > 0) {
-                    double var = 0;
-                    for (int c = 0; c < 3; c++) {
-                        double mean = (double)sum[c] / count;
-                        var += (sum_sq[c] - 2 * mean * sum[c] + count * mean * mean) / count;
-                    }
-                    var /= 3;
-
-                    if (var < min_var) {
-                        min_var = var;
-                        for (int c = 0; c < 3; c++) {
-                            best_mean[c] = sum[c] / count;
-                        }
-                    }
-                }
-            }
-
-            int out_idx = (y * width + x) * 3;
-            for (int c = 0; c < 3; c++) {
-                tmp[out_idx + c] = (uint8_t)best_mean[c];
-            }
-        }
-    }
+static struct frame * frame_read(struct frame *f) {
+  if ((f = frame_read_header(f)))
+    fread(f->data, f->width * f->height, f->channels, stdin);
+  return f;
+}
+
+// (re)allocate out to the shape of f, reusing it when it already matches
+static struct frame * frame_like(struct frame *out, struct frame *f) {
+  if (!out || out->width != f->width || out->height != f->height || out->channels != f->channels) {
+    free(out);
+    out = frame_create(f->width, f->height, f->channels);
+  }
+  return out;
+}
 
-    memcpy(img, tmp, height * width * 3 * sizeof(unsigned char));
-    free(tmp);
+// Quality levels for --fps, cheapest last: the ksize itself, then smaller odd
+// sizes each about three quarters of the one before, down to 3, then the
+// smallest again at half resolution. Returns the number of levels.
+static int kuwahara_levels(struct quality levels[], int ksize) {
+  int n = 0;
+  levels[n++] = (struct quality){ksize, false};
+  for (int k = ksize * 3 / 4; k >= 3; k = k * 3 / 4) {
+    if (k % 2 == 0)
+      k--;
+    levels[n++] = (struct quality){k, false};
+  }
+  levels[n] = (struct quality){levels[n - 1].param, true};
+  return n + 1;
 }
 
 int main(int argc, char *argv[])
 {
+  int ksize = 7;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--ksize") == 0) {
+      char *end;
+      long v = strtol(argv[i + 1], &end, 10);
+      if (end == argv[i + 1] || *end || v < 1 || v > KUWAHARA_MAX_KSIZE) {
+        fprintf(stderr, "Usage: %s [--ksize 1-%d] (got --ksize %s)\n", argv[0], KUWAHARA_MAX_KSIZE, argv[i + 1]);
+        return 1;
+      }
+      ksize = (int)v;
+    }
+  }
+
+  struct quality levels[16];
+  struct deadline d;
+  deadline_init(&d, deadline_parse_fps(argc, argv), levels, kuwahara_levels(levels, ksize));
+
+  struct roi roi;
+  if (!roi_init(&roi, argc, argv))
+    return 1;
+
+  struct perf perf;
+  perf_init(&perf, "kuwahara", argc, argv);
+
+  // --store filters a frame range straight out of the mapped store
+  const char *path;
+  size_t first, last;
+  if (!store_parse(argc, argv, &path, &first, &last))
+    return 1;
+  if (path) {
+    struct store s;
+    if (!store_open(&s, path))
+      return 1;
+    if (!store_check_range(&s, first)) {
+      store_close(&s);
+      return 1;
+    }
+    store_prefetch(&s, first, last);
+    roi_skip(&roi, first);
+    struct frame *out = frame_create(s.width, s.height, s.channels);
+    for (size_t i = first; i <= last && i < s.count; i++) {
+      roi_next(&roi);
+      perf_begin(&perf);
+      deadline_run(&d, kuwahara, store_frame(&s, i), out->data, out->width, out->height, out->channels);
+      perf_end(&perf, out->width * out->height, 2 * out->width * out->height * out->channels);
+      frame_write(out);
+    }
+    deadline_finish(&d);
+    perf_report(&perf);
+    roi_close(&roi);
+    store_close(&s);
+    free(out);
+    return 0;
+  }
+
+  // --stream writes each band of rows as soon as the rows it needs are in
+  if (band_enabled(argc, argv)) {
+    struct frame *out = 0;
+    struct frame *f = 0;
+    while ((f = frame_read_header(f))) {
+      out = frame_like(out, f);
+      roi_next(&roi);
+      frame_write_header(out);
+      if (!band_stream(f->data, out->data, f->width, f->height, f->channels, levels[0].param / 2, kuwahara, levels[0].param, &perf))
+        break;
+    }
+    perf_report(&perf);
+    roi_close(&roi);
+    free(out);
+    free(f);
+    return 0;
+  }
+
+  struct frame *out = 0;
   struct frame *f = frame_read(0);
+  roi_skip(&roi, 1);
 
   while ((f = frame_read(f))) {
-    kuwahara(f->data, f->width, f->height, 7);
+    out = frame_like(out, f);
+    roi_next(&roi);
+    perf_begin(&perf);
+    deadline_run(&d, kuwahara, f->data, out->data, f->width, f->height, f->channels);
+    perf_end(&perf, f->width * f->height, 2 * f->width * f->height * f->channels);
+
+    // the old input becomes the next frame's output buffer
+    struct frame *tmp = f;
+    f = out;
+    out = tmp;
     frame_write(f);
   }
 
+  deadline_finish(&d);
+  perf_report(&perf);
+  roi_close(&roi);
+  free(out);
   free(f);
 }
 
@@ -0,0 +1,115 @@
+// Kuwahara kernel, shared by ./kuwahara and ./filterd
+#ifndef VIDEO_KUWAHARA_H
+#define VIDEO_KUWAHARA_H
+
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tile.h"
+
+// largest ksize filterd accepts from a client; the uint32 quadrant sums of
+// squares stay exact far beyond it
+#define KUWAHARA_MAX_KSIZE 64
+
+// One tile of the filter. Summed-area tables of the values and their squares
+// over the tile plus its halo live in scratch, so every quadrant sum is four
+// lookups instead of a pad x pad loop. The tables are unsigned so differences
+// stay exact even if a running total wraps.
+static void kuwahara_tile(const unsigned char img[], unsigned char out[], int width, int height, int channels, struct tile t, int ksize) {
+    int pad = ksize / 2;
+    int y0 = t.y0 - pad < 0 ? 0 : t.y0 - pad;
+    int y1 = t.y1 + pad > height ? height : t.y1 + pad;
+    int x0 = t.x0 - pad < 0 ? 0 : t.x0 - pad;
+    int x1 = t.x1 + pad > width ? width : t.x1 + pad;
+    int sw = x1 - x0 + 1;
+    size_t cells = (size_t)(y1 - y0 + 1) * sw * channels;
+    uint32_t *sat = tile_scratch(2 * cells * sizeof(uint32_t));
+    uint32_t *sat_sq = sat + cells;
+
+    memset(sat, 0, sw * channels * sizeof(uint32_t));
+    memset(sat_sq, 0, sw * channels * sizeof(uint32_t));
+    for (int y = y0; y < y1; y++) {
+        uint32_t *row = &sat[(y - y0 + 1) * sw * channels];
+        uint32_t *row_sq = &sat_sq[(y - y0 + 1) * sw * channels];
+        uint32_t acc[3] = {0, 0, 0};
+        uint32_t acc_sq[3] = {0, 0, 0};
+        for (int c = 0; c < channels; c++) {
+            row[c] = 0;
+            row_sq[c] = 0;
+        }
+        for (int x = x0; x < x1; x++) {
+            int idx = (y * width + x) * channels;
+            int cell = (x - x0 + 1) * channels;
+            for (int c = 0; c < channels; c++) {
+                uint32_t val = img[idx + c];
+                acc[c] += val;
+                acc_sq[c] += val * val;
+                row[cell + c] = row[cell - sw * channels + c] + acc[c];
+                row_sq[cell + c] = row_sq[cell - sw * channels + c] + acc_sq[c];
+            }
+        }
+    }
+
+    for (int y = t.y0; y < t.y1; y++) {
+        for (int x = t.x0; x < t.x1; x++) {
+            double min_var = DBL_MAX;
+            int best_mean[3] = {0, 0, 0};
+
+            int regions[4][4] = {
+                {-pad, -pad, 0, 0},           // top left
+                {-pad, 0, 0, pad},            // top right
+                {0, -pad, pad, 0},            // bottom left
+                {0, 0, pad, pad}              // bottom right
+            };
+
+            for (int r = 0; r < 4; r++) {
+                int sum[3] = {0, 0, 0};
+                int sum_sq[3] = {0, 0, 0};
+
+                // clip the quadrant to the frame, then to table coordinates
+                int top = y + regions[r][0] < 0 ? 0 : y + regions[r][0];
+                int left = x + regions[r][1] < 0 ? 0 : x + regions[r][1];
+                int bottom = y + regions[r][2] >= height ? height - 1 : y + regions[r][2];
+                int right = x + regions[r][3] >= width ? width - 1 : x + regions[r][3];
+                int count = (bottom - top + 1) * (right - left + 1);
+
+                int tl = ((top - y0) * sw + left - x0) * channels;
+                int tr = ((top - y0) * sw + right - x0 + 1) * channels;
+                int bl = ((bottom - y0 + 1) * sw + left - x0) * channels;
+                int br = ((bottom - y0 + 1) * sw + right - x0 + 1) * channels;
+                for (int c = 0; c < channels; c++) {
+                    sum[c] = sat[br + c] - sat[tr + c] - sat[bl + c] + sat[tl + c];
+                    sum_sq[c] = sat_sq[br + c] - sat_sq[tr + c] - sat_sq[bl + c] + sat_sq[tl + c];
+                }
+
+                if (count > 0) {
+                    double var = 0;
+                    for (int c = 0; c < channels; c++) {
+                        double mean = (double)sum[c] / count;
+                        var += (sum_sq[c] - 2 * mean * sum[c] + count * mean * mean) / count;
+                    }
+                    var /= channels;
+
+                    if (var < min_var) {
+                        min_var = var;
+                        for (int c = 0; c < channels; c++) {
+                            best_mean[c] = sum[c] / count;
+                        }
+                    }
+                }
+            }
+
+            int out_idx = (y * width + x) * channels;
+            for (int c = 0; c < channels; c++) {
+                out[out_idx + c] = (uint8_t)best_mean[c];
+            }
+        }
+    }
+}
+
+static void kuwahara(const unsigned char img[], unsigned char out[], int width, int height, int channels, int ksize) {
+    tile_run(img, out, width, height, channels, kuwahara_tile, ksize);
+}
+
+#endif
@@ -0,0 +1,152 @@
+// Opt-in hardware counter profiling (--perf). Each kernel call is wrapped in
+// perf_begin/perf_end, which count cycles, instructions, L1D read misses, LLC
+// misses and branch misses for this thread in user space, and perf_report
+// prints IPC, misses per pixel and effective bandwidth to stderr at exit.
+// Counters the kernel or CPU won't give us (containers, VMs, a strict
+// perf_event_paranoid) are reported as n/a, leaving wall-clock timing.
+#ifndef VIDEO_PERF_H
+#define VIDEO_PERF_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_COUNTERS };
+
+static const char *perf_names[PERF_COUNTERS] = {"cycles", "instructions", "L1 misses", "LLC misses", "branch misses"};
+
+struct perf {
+  bool enabled;
+  const char *kernel;
+  int fd[PERF_COUNTERS];
+  int error;  // errno of the first counter that failed to open
+  uint64_t counts[PERF_COUNTERS];
+  double start;
+  double seconds;
+  long calls;
+  double pixels;
+  double bytes;
+};
+
+static double perf_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void perf_init(struct perf *p, const char *kernel, int argc, char *argv[]) {
+  memset(p, 0, sizeof(*p));
+  p->kernel = kernel;
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    p->fd[i] = -1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--perf") == 0)
+      p->enabled = true;
+  }
+  if (!p->enabled)
+    return;
+
+#ifdef __linux__
+  static const struct { uint32_t type; uint64_t config; } events[PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  };
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    p->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (p->fd[i] < 0 && !p->error)
+      p->error = errno;
+  }
+#else
+  p->error = ENOSYS;
+#endif
+}
+
+static void perf_begin(struct perf *p) {
+  if (!p->enabled)
+    return;
+#ifdef __linux__
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (p->fd[i] >= 0) {
+      ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+  p->start = perf_now();
+}
+
+// pixels processed and bytes read plus written by the call just finished
+static void perf_end(struct perf *p, size_t pixels, size_t bytes) {
+  if (!p->enabled)
+    return;
+  p->seconds += perf_now() - p->start;
+#ifdef __linux__
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    uint64_t count;
+    if (p->fd[i] >= 0) {
+      ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(p->fd[i], &count, sizeof(count)) == sizeof(count))
+        p->counts[i] += count;
+    }
+  }
+#endif
+  p->calls++;
+  p->pixels += pixels;
+  p->bytes += bytes;
+}
+
+static void perf_report(struct perf *p) {
+  if (!p->enabled)
+    return;
+
+  fprintf(stderr, "perf: %s: %ld calls, %.0f pixels, %.6f s, %.2f GB/s effective\n",
+          p->kernel, p->calls, p->pixels, p->seconds, p->seconds > 0 ? p->bytes / p->seconds / 1e9 : 0);
+  int available = 0;
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    available += p->fd[i] >= 0;
+  if (available == 0) {
+    fprintf(stderr, "perf: %s: counters unavailable (%s), timing only\n", p->kernel, strerror(p->error));
+    return;
+  }
+
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (p->fd[i] < 0)
+      fprintf(stderr, "perf: %s:   %-14s n/a\n", p->kernel, perf_names[i]);
+    else if (i == PERF_CYCLES || i == PERF_INSTRUCTIONS)
+      fprintf(stderr, "perf: %s:   %-14s %.0f\n", p->kernel, perf_names[i], (double)p->counts[i]);
+    else
+      fprintf(stderr, "perf: %s:   %-14s %.0f (%.4f per pixel)\n", p->kernel, perf_names[i],
+              (double)p->counts[i], p->pixels > 0 ? p->counts[i] / p->pixels : 0);
+  }
+  if (p->fd[PERF_CYCLES] >= 0 && p->fd[PERF_INSTRUCTIONS] >= 0 && p->counts[PERF_CYCLES] > 0)
+    fprintf(stderr, "perf: %s:   %-14s %.2f\n", p->kernel, "IPC",
+            (double)p->counts[PERF_INSTRUCTIONS] / p->counts[PERF_CYCLES]);
+
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (p->fd[i] >= 0)
+      close(p->fd[i]);
+  }
+}
+
+#endif
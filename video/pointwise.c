@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuse.h"
+#include "perf.h"
+
+struct frame {
+  size_t width;
+  size_t height;
+  size_t channels;
+  unsigned char data[];
+};
+
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
+  f->width = width;
+  f->height = height;
+  f->channels = channels;
+  return f;
+}
+
+// P5 (greymap) for single-channel frames, P6 otherwise
+static void frame_write(struct frame *f) {
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
+}
+
+static struct frame * frame_read(struct frame *f) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
+    free(f);
+    return 0;
+  }
+  channels = magic == 5 ? 1 : 3;
+
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
+    free(f);
+    f = frame_create(width, height, channels);
+  }
+  fread(f->data, width * height, channels, stdin);
+  return f;
+}
+
+// Run a chain of pointwise effects in one pass, e.g. ./pointwise grey dither websafe
+int main(int argc, char *argv[])
+{
+  enum px_op ops[16];
+  int nops = 0;
+  char chain[256] = "";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--perf") == 0)
+      continue;
+    if (nops == 16 || !fused_parse_op(argv[i], &ops[nops])) {
+      fprintf(stderr, "Usage: %s [grey|dither|dither2|websafe] ...\n", argv[0]);
+      return 1;
+    }
+    nops++;
+    snprintf(chain + strlen(chain), sizeof(chain) - strlen(chain), "%s%s", nops > 1 ? " " : "", argv[i]);
+  }
+
+  fused_init();
+  fused_fn fn = fused_lookup(chain);
+  struct perf perf;
+  perf_init(&perf, fn ? "pointwise (fused)" : "pointwise (generic)", argc, argv);
+  struct frame *f = 0;
+
+  while ((f = frame_read(f))) {
+    perf_begin(&perf);
+    if (fn)
+      fn(f->data, f->width, f->height, f->channels);
+    else
+      fused_generic(f->data, f->width, f->height, f->channels, ops, nops);
+    perf_end(&perf, f->width * f->height, 2 * f->width * f->height * f->channels);
+    frame_write(f);
+  }
+
+  perf_report(&perf);
+}
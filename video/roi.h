@@ -0,0 +1,76 @@
+// Region-of-interest options for the neighbourhood filters. Rectangles are
+// written x,y,w,h and separated by spaces:
+//
+//   --roi 100,50,320,240 [--roi ...]   the same rectangles on every frame
+//   --roi-file boxes.txt               one line of rectangles per frame
+//
+// A sidecar line with no rectangles passes that frame straight through, and
+// once the file runs out the last line keeps applying. The rectangles are
+// installed as the tile layer's regions of interest before each frame.
+#ifndef VIDEO_ROI_H
+#define VIDEO_ROI_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tile.h"
+
+struct roi {
+  bool active;
+  FILE *sidecar;
+  struct tile rects[TILE_MAX_ROI];
+  int count;
+};
+
+// parse "x,y,w,h x,y,w,h ..." into rects, returning how many were read
+static int roi_parse_rects(const char *s, struct tile rects[], int max) {
+  int count = 0;
+  int x, y, w, h, n;
+  while (count < max && sscanf(s, " %d,%d,%d,%d%n", &x, &y, &w, &h, &n) == 4) {
+    rects[count++] = (struct tile){x, y, x + w, y + h};
+    s += n;
+  }
+  return count;
+}
+
+static bool roi_init(struct roi *r, int argc, char *argv[]) {
+  memset(r, 0, sizeof(*r));
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--roi") == 0) {
+      r->active = true;
+      r->count += roi_parse_rects(argv[i + 1], &r->rects[r->count], TILE_MAX_ROI - r->count);
+    } else if (strcmp(argv[i], "--roi-file") == 0) {
+      r->active = true;
+      r->sidecar = fopen(argv[i + 1], "r");
+      if (!r->sidecar) {
+        fprintf(stderr, "Error opening ROI file %s\n", argv[i + 1]);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Install the rectangles for the next frame.
+static void roi_next(struct roi *r) {
+  char line[4096];
+  if (r->sidecar && fgets(line, sizeof(line), r->sidecar))
+    r->count = roi_parse_rects(line, r->rects, TILE_MAX_ROI);
+
+  tile_roi_count = r->active ? r->count : -1;
+  memcpy(tile_roi, r->rects, r->count * sizeof(r->rects[0]));
+}
+
+// skip the sidecar lines of frames before the first one processed
+static void roi_skip(struct roi *r, size_t frames) {
+  for (size_t i = 0; i < frames; i++)
+    roi_next(r);
+}
+
+static void roi_close(struct roi *r) {
+  if (r->sidecar)
+    fclose(r->sidecar);
+}
+
+#endif
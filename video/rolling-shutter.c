@@ -6,33 +6,38 @@
 struct frame {
   size_t width;
   size_t height;
+  size_t channels;
   unsigned char data[];
 };
 
-static struct frame * frame_create(size_t width, size_t height) {
-  struct frame *f = malloc(sizeof(*f) + width * height * 3);
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
   f->width = width;
   f->height = height;
+  f->channels = channels;
   return f;
 }
 
+// P5 (greymap) for single-channel frames, P6 otherwise
 static void frame_write(struct frame *f) {
-  printf("P6\n%zu %zu\n255\n", f->width, f->height);
-  fwrite(f->data, f->width*f->height, 3, stdout);
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
 }
 
 static struct frame * frame_read(struct frame *f) {
-  size_t width, height;
-  if (scanf("P6 %zu%zu%*d%*c", &width, &height) < 2) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
     free(f);
     return 0;
   }
+  channels = magic == 5 ? 1 : 3;
 
-  if (!f || f->width != width || f->height != height) {
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
     free(f);
-    f = frame_create(width, height);
+    f = frame_create(width, height, channels);
   }
-  fread(f->data, width * height, 3, stdin);
+  fread(f->data, width * height, channels, stdin);
   return f;
 }
 
@@ -41,11 +46,11 @@ int main(int argc, char *argv[])
   int shutter_step = 6;
   size_t shutter = 0;
   struct frame *f = frame_read(0);
-  struct frame *out = frame_create(f->width, f->height);
+  struct frame *out = frame_create(f->width, f->height, f->channels);
 
   while (shutter < f->height && (f = frame_read(f))) {
-    size_t offset = shutter * f->width * 3;
-    size_t length = f->height * f->width * 3 - offset;
+    size_t offset = shutter * f->width * f->channels;
+    size_t length = f->height * f->width * f->channels - offset;
     memcpy(out->data + offset, f->data + offset, length);
     frame_write(out);
     shutter += shutter_step;
@@ -0,0 +1,94 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "framestore.h"
+
+struct frame {
+  size_t width;
+  size_t height;
+  size_t channels;
+  unsigned char data[];
+};
+
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
+  f->width = width;
+  f->height = height;
+  f->channels = channels;
+  return f;
+}
+
+static struct frame * frame_read(struct frame *f) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
+    free(f);
+    return 0;
+  }
+  channels = magic == 5 ? 1 : 3;
+
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
+    free(f);
+    f = frame_create(width, height, channels);
+  }
+  fread(f->data, width * height, channels, stdin);
+  return f;
+}
+
+// Write a PPM/PGM stream from stdin into a frame store, e.g.
+// ffmpeg -i input.mp4 -f image2pipe -vcodec ppm pipe:1 | ./store clip.raw
+int main(int argc, char *argv[])
+{
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <output.raw>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(argv[1], "wb");
+  if (!file) {
+    fprintf(stderr, "Error opening %s for writing\n", argv[1]);
+    return 1;
+  }
+
+  struct store_header h = {STORE_MAGIC};
+  uint64_t *index = 0;
+  size_t cap = 0;
+  unsigned char pad[STORE_ALIGN] = {0};
+  struct frame *f = 0;
+
+  while ((f = frame_read(f))) {
+    if (h.count == 0) {
+      h.width = f->width;
+      h.height = f->height;
+      h.channels = f->channels;
+      h.stride = store_stride(f->width, f->height, f->channels);
+    } else if (f->width != h.width || f->height != h.height || f->channels != h.channels) {
+      fprintf(stderr, "Frame %llu changes shape, stopping\n", (unsigned long long)h.count);
+      free(f);
+      break;
+    }
+
+    if (h.count == cap) {
+      cap = cap ? cap * 2 : 1024;
+      index = realloc(index, cap * sizeof(*index));
+    }
+    index[h.count] = STORE_ALIGN + h.count * h.stride;
+    fseek(file, index[h.count], SEEK_SET);
+    fwrite(f->data, f->width * f->height, f->channels, file);
+    h.count++;
+  }
+
+  // pad the last frame out to its stride, then the index, then the real header
+  size_t bytes = (size_t)h.width * h.height * h.channels;
+  fwrite(pad, 1, h.stride - bytes, file);
+  h.index = STORE_ALIGN + h.count * h.stride;
+  fseek(file, h.index, SEEK_SET);
+  fwrite(index, sizeof(*index), h.count, file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&h, sizeof(h), 1, file);
+  fclose(file);
+  free(index);
+
+  fprintf(stderr, "%llu frames of %ux%u stored in %s\n", (unsigned long long)h.count, h.width, h.height, argv[1]);
+}
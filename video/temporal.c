@@ -0,0 +1,240 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "perf.h"
+
+// Temporal filters over the frame sequence, each O(1) per pixel no matter
+// how long the window is:
+//
+//   ./temporal average N   mean of the last N frames (N <= 256), kept as a
+//                          16-bit running sum over a ring of N frames
+//   ./temporal echo D      exponential decay trail, D in [0, 1)
+//   ./temporal denoise S   approximate running median: every frame each
+//                          sample moves at most S levels towards the input
+
+struct frame {
+  size_t width;
+  size_t height;
+  size_t channels;
+  unsigned char data[];
+};
+
+static struct frame * frame_create(size_t width, size_t height, size_t channels) {
+  struct frame *f = malloc(sizeof(*f) + width * height * channels);
+  f->width = width;
+  f->height = height;
+  f->channels = channels;
+  return f;
+}
+
+// P5 (greymap) for single-channel frames, P6 otherwise
+static void frame_write(struct frame *f) {
+  printf("P%d\n%zu %zu\n255\n", f->channels == 1 ? 5 : 6, f->width, f->height);
+  fwrite(f->data, f->width*f->height, f->channels, stdout);
+}
+
+static struct frame * frame_read(struct frame *f) {
+  int magic;
+  size_t width, height, channels;
+  if (scanf("P%d %zu%zu%*d%*c", &magic, &width, &height) < 3 || (magic != 5 && magic != 6)) {
+    free(f);
+    return 0;
+  }
+  channels = magic == 5 ? 1 : 3;
+
+  if (!f || f->width != width || f->height != height || f->channels != channels) {
+    free(f);
+    f = frame_create(width, height, channels);
+  }
+  fread(f->data, width * height, channels, stdin);
+  return f;
+}
+
+// (re)allocate out to the shape of f, reusing it when it already matches
+static struct frame * frame_like(struct frame *out, struct frame *f) {
+  if (!out || out->width != f->width || out->height != f->height || out->channels != f->channels) {
+    free(out);
+    out = frame_create(f->width, f->height, f->channels);
+  }
+  return out;
+}
+
+enum mode { AVERAGE, ECHO, DENOISE };
+
+struct temporal {
+  enum mode mode;
+  int window;           // frames in the average
+  int decay;            // echo decay in 1/256ths
+  int step;             // denoise step
+  size_t size;          // samples per frame
+  size_t frames;        // frames seen since the last reset
+  unsigned char *ring;  // last `window` frames, for the average
+  uint16_t *acc;        // running sum (average) or 8.8 fixed-point value (echo)
+  unsigned char *median;
+  unsigned char lut[65536];  // acc -> acc / n for the current n
+  int lut_n;
+};
+
+// drop all history, e.g. when the frame shape changes
+static void temporal_reset(struct temporal *t, size_t size) {
+  free(t->ring);
+  free(t->acc);
+  free(t->median);
+  t->size = size;
+  t->frames = 0;
+  t->lut_n = 0;
+  t->ring = t->mode == AVERAGE ? malloc(t->window * size) : 0;
+  t->acc = calloc(size, sizeof(uint16_t));
+  t->median = malloc(size);
+}
+
+// acc += in - old, sixteen lanes at a time
+static void accumulate(uint16_t acc[], const unsigned char in[], const unsigned char old[], size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+    __m128i o = old ? _mm_loadu_si128((const __m128i *)&old[i]) : zero;
+    __m128i lo = _mm_loadu_si128((const __m128i *)&acc[i]);
+    __m128i hi = _mm_loadu_si128((const __m128i *)&acc[i + 8]);
+    lo = _mm_sub_epi16(_mm_add_epi16(lo, _mm_unpacklo_epi8(x, zero)), _mm_unpacklo_epi8(o, zero));
+    hi = _mm_sub_epi16(_mm_add_epi16(hi, _mm_unpackhi_epi8(x, zero)), _mm_unpackhi_epi8(o, zero));
+    _mm_storeu_si128((__m128i *)&acc[i], lo);
+    _mm_storeu_si128((__m128i *)&acc[i + 8], hi);
+  }
+#endif
+  for (; i < n; i++)
+    acc[i] += in[i] - (old ? old[i] : 0);
+}
+
+// acc = acc * decay + (in << 8) * (1 - decay), in 8.8 fixed point
+static void decay(uint16_t acc[], const unsigned char in[], int d, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  __m128i keep = _mm_set1_epi16((short)(d << 8));
+  __m128i take = _mm_set1_epi16((short)(256 - d));
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+    __m128i lo = _mm_loadu_si128((const __m128i *)&acc[i]);
+    __m128i hi = _mm_loadu_si128((const __m128i *)&acc[i + 8]);
+    lo = _mm_add_epi16(_mm_mulhi_epu16(lo, keep), _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), take));
+    hi = _mm_add_epi16(_mm_mulhi_epu16(hi, keep), _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), take));
+    _mm_storeu_si128((__m128i *)&acc[i], lo);
+    _mm_storeu_si128((__m128i *)&acc[i + 8], hi);
+  }
+#endif
+  for (; i < n; i++)
+    acc[i] = (uint16_t)(((uint32_t)acc[i] * (d << 8) >> 16) + in[i] * (256 - d));
+}
+
+// move every sample of m at most step levels towards in
+static void approach(unsigned char m[], const unsigned char in[], int step, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i s = _mm_set1_epi8((char)step);
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+    __m128i v = _mm_loadu_si128((const __m128i *)&m[i]);
+    __m128i up = _mm_min_epu8(_mm_subs_epu8(x, v), s);
+    __m128i down = _mm_min_epu8(_mm_subs_epu8(v, x), s);
+    _mm_storeu_si128((__m128i *)&m[i], _mm_sub_epi8(_mm_add_epi8(v, up), down));
+  }
+#endif
+  for (; i < n; i++) {
+    int d = in[i] - m[i];
+    m[i] += d > step ? step : d < -step ? -step : d;
+  }
+}
+
+static void temporal_apply(struct temporal *t, const unsigned char in[], unsigned char out[]) {
+  size_t n = t->size;
+
+  if (t->mode == AVERAGE) {
+    // the ring slot about to be overwritten holds the frame leaving the window
+    unsigned char *slot = &t->ring[(t->frames % t->window) * n];
+    accumulate(t->acc, in, t->frames >= (size_t)t->window ? slot : 0, n);
+    memcpy(slot, in, n);
+
+    int count = t->frames + 1 < (size_t)t->window ? (int)t->frames + 1 : t->window;
+    if (t->lut_n != count) {
+      for (int i = 0; i < 65536; i++)
+        t->lut[i] = (unsigned char)(i / count < 255 ? i / count : 255);
+      t->lut_n = count;
+    }
+    for (size_t i = 0; i < n; i++)
+      out[i] = t->lut[t->acc[i]];
+  } else if (t->mode == ECHO) {
+    if (t->frames == 0) {
+      for (size_t i = 0; i < n; i++)
+        t->acc[i] = in[i] << 8;
+    } else {
+      decay(t->acc, in, t->decay, n);
+    }
+    for (size_t i = 0; i < n; i++)
+      out[i] = t->acc[i] >> 8;
+  } else {
+    if (t->frames == 0)
+      memcpy(t->median, in, n);
+    else
+      approach(t->median, in, t->step, n);
+    memcpy(out, t->median, n);
+  }
+
+  t->frames++;
+}
+
+int main(int argc, char *argv[])
+{
+  struct temporal t = {0};
+  if (argc >= 3 && strcmp(argv[1], "average") == 0) {
+    t.mode = AVERAGE;
+    t.window = atoi(argv[2]);
+  } else if (argc >= 3 && strcmp(argv[1], "echo") == 0) {
+    t.mode = ECHO;
+    t.decay = (int)(atof(argv[2]) * 256);
+  } else if (argc >= 3 && strcmp(argv[1], "denoise") == 0) {
+    t.mode = DENOISE;
+    t.step = atoi(argv[2]);
+  } else {
+    fprintf(stderr, "Usage: %s average N | echo DECAY | denoise STEP\n", argv[0]);
+    return 1;
+  }
+  if ((t.mode == AVERAGE && (t.window < 1 || t.window > 256)) ||
+      (t.mode == ECHO && (t.decay < 0 || t.decay > 255)) ||
+      (t.mode == DENOISE && (t.step < 1 || t.step > 255))) {
+    fprintf(stderr, "Window must be 1-256, decay in [0, 1) and step 1-255\n");
+    return 1;
+  }
+
+  struct perf perf;
+  perf_init(&perf, argv[1], argc, argv);
+  struct frame *out = 0;
+  struct frame *f = 0;
+
+  while ((f = frame_read(f))) {
+    size_t size = f->width * f->height * f->channels;
+    if (!out || out->width != f->width || out->height != f->height || out->channels != f->channels)
+      temporal_reset(&t, size);
+    out = frame_like(out, f);
+
+    perf_begin(&perf);
+    temporal_apply(&t, f->data, out->data);
+    perf_end(&perf, f->width * f->height, 2 * size);
+    frame_write(out);
+  }
+
+  perf_report(&perf);
+  free(t.ring);
+  free(t.acc);
+  free(t.median);
+  free(out);
+}
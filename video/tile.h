@@ -0,0 +1,88 @@
+// Cache-blocked traversal for neighbourhood filters: the frame is walked in
+// row-major order of TILE_W x TILE_H tiles so a tile plus its halo stays in L2,
+// reading from src and writing to a separate dst (no copy back).
+#ifndef VIDEO_TILE_H
+#define VIDEO_TILE_H
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TILE_W 256
+#define TILE_H 32
+#define TILE_MAX_ROI 64
+
+// output rectangle of one tile, end exclusive
+struct tile {
+  int x0, y0;
+  int x1, y1;
+};
+
+typedef void (*tile_fn)(const unsigned char src[], unsigned char dst[], int width, int height, int channels, struct tile t, int param);
+
+// Optional regions of interest, per thread. With a count of -1 tile_run covers
+// the whole frame; otherwise it copies src through to dst and only runs the
+// kernel over tiles inside these rectangles. The kernels read their halo from
+// src, so edges of a region see real neighbours.
+static _Thread_local struct tile tile_roi[TILE_MAX_ROI];
+static _Thread_local int tile_roi_count = -1;
+
+// Rows [tile_row0, tile_row1) that tile_run produces, so a frame can be
+// filtered band by band as its rows arrive. The whole frame by default.
+static _Thread_local int tile_row0 = 0;
+static _Thread_local int tile_row1 = INT_MAX;
+
+static void tile_rect(const unsigned char src[], unsigned char dst[], int width, int height, int channels, tile_fn fn, int param, struct tile r) {
+  for (int y = r.y0; y < r.y1; y += TILE_H) {
+    for (int x = r.x0; x < r.x1; x += TILE_W) {
+      struct tile t = {x, y, x + TILE_W < r.x1 ? x + TILE_W : r.x1, y + TILE_H < r.y1 ? y + TILE_H : r.y1};
+      fn(src, dst, width, height, channels, t, param);
+    }
+  }
+}
+
+// a region of interest clipped to the frame; empty when x0 >= x1 or y0 >= y1
+static struct tile tile_clip(struct tile r, int width, int height) {
+  r.x0 = r.x0 < 0 ? 0 : r.x0;
+  r.y0 = r.y0 < 0 ? 0 : r.y0;
+  r.x1 = r.x1 > width ? width : r.x1;
+  r.y1 = r.y1 > height ? height : r.y1;
+  return r;
+}
+
+static void tile_run(const unsigned char src[], unsigned char dst[], int width, int height, int channels, tile_fn fn, int param) {
+  int y0 = tile_row0 > 0 ? tile_row0 : 0;
+  int y1 = tile_row1 < height ? tile_row1 : height;
+  if (y0 >= y1)
+    return;
+
+  if (tile_roi_count < 0) {
+    tile_rect(src, dst, width, height, channels, fn, param, (struct tile){0, y0, width, y1});
+    return;
+  }
+
+  size_t stride = (size_t)width * channels;
+  memcpy(&dst[y0 * stride], &src[y0 * stride], (y1 - y0) * stride);
+  for (int i = 0; i < tile_roi_count; i++) {
+    struct tile r = tile_clip(tile_roi[i], width, height);
+    r.y0 = r.y0 > y0 ? r.y0 : y0;
+    r.y1 = r.y1 < y1 ? r.y1 : y1;
+    if (r.x0 < r.x1 && r.y0 < r.y1)
+      tile_rect(src, dst, width, height, channels, fn, param, r);
+  }
+}
+
+// Per-thread scratch that persists across tiles and frames and only grows.
+// There is one slot per thread, so a tile function carves it up itself.
+static void * tile_scratch(size_t size) {
+  static _Thread_local void *buf;
+  static _Thread_local size_t cap;
+  if (cap < size) {
+    free(buf);
+    buf = malloc(size);
+    cap = size;
+  }
+  return buf;
+}
+
+#endif